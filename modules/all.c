@@ -23,12 +23,20 @@
 #include "vlock_plugin.h"
 #include "console_switch.h"
 
-bool vlock_start(void __attribute__((unused)) **ctx_ptr)
+static bool all_start(void __attribute__((unused)) **ctx_ptr)
 {
   return lock_console_switch();
 }
 
-bool vlock_end(void __attribute__((unused)) **ctx_ptr)
+static bool all_end(void __attribute__((unused)) **ctx_ptr)
 {
   return unlock_console_switch();
 }
+
+const struct vlock_plugin_descriptor VLOCK_PLUGIN_DESCRIPTOR_NAME = {
+  .abi_version = VLOCK_PLUGIN_ABI_VERSION,
+  .hooks = {
+    [VLOCK_HOOK_START] = all_start,
+    [VLOCK_HOOK_END] = all_end,
+  },
+};
@@ -19,7 +19,8 @@
  * submit your module for inclusion. */
 
 /* Include this header file to make sure the types of the dependencies
- * and hooks are correct. */
+ * and hooks are correct.  This example uses the older interface of
+ * separate symbols.  See PLUGINS for the descriptor interface. */
 #include "vlock_plugin.h"
 
 /* Declare dependencies.  Please see PLUGINS for their meaning.  Empty
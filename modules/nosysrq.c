@@ -19,8 +19,8 @@
 
 #include "vlock_plugin.h"
 
-const char *preceeds[] = { "new", "all", NULL };
-const char *depends[] = { "all", NULL };
+static const char *const nosysrq_preceeds[] = { "new", "all", NULL };
+static const char *const nosysrq_depends[] = { "all", NULL };
 
 #define SYSRQ_PATH "/proc/sys/kernel/sysrq"
 #define SYSRQ_DISABLE_VALUE "0\n"
@@ -31,7 +31,7 @@ struct sysrq_context {
 };
 
 /* Disable SysRq and save old value in context. */
-bool vlock_start(void **ctx_ptr)
+static bool nosysrq_start(void **ctx_ptr)
 {
   struct sysrq_context *ctx;
 
@@ -92,7 +92,7 @@ err:
 
 
 /* Restore old SysRq value. */
-bool vlock_end(void **ctx_ptr)
+static bool nosysrq_end(void **ctx_ptr)
 {
   struct sysrq_context *ctx = *ctx_ptr;
 
@@ -108,3 +108,13 @@ bool vlock_end(void **ctx_ptr)
   free(ctx);
   return true;
 }
+
+const struct vlock_plugin_descriptor VLOCK_PLUGIN_DESCRIPTOR_NAME = {
+  .abi_version = VLOCK_PLUGIN_ABI_VERSION,
+  .hooks = {
+    [VLOCK_HOOK_START] = nosysrq_start,
+    [VLOCK_HOOK_END] = nosysrq_end,
+  },
+  .preceeds = nosysrq_preceeds,
+  .depends = nosysrq_depends,
+};
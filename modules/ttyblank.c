@@ -18,16 +18,25 @@
 
 #include "vlock_plugin.h"
 
-const char *depends[] = { "all", NULL };
+static const char *const ttyblank_depends[] = { "all", NULL };
 
-bool vlock_save(void __attribute__ ((__unused__)) ** ctx)
+static bool ttyblank_save(void __attribute__ ((__unused__)) ** ctx)
 {
   char arg[] = { TIOCL_BLANKSCREEN, 0 };
   return ioctl(STDIN_FILENO, TIOCLINUX, arg) == 0;
 }
 
-bool vlock_save_abort(void __attribute__ ((__unused__)) ** ctx)
+static bool ttyblank_save_abort(void __attribute__ ((__unused__)) ** ctx)
 {
   char arg[] = { TIOCL_UNBLANKSCREEN, 0 };
   return ioctl(STDIN_FILENO, TIOCLINUX, arg) == 0;
 }
+
+const struct vlock_plugin_descriptor VLOCK_PLUGIN_DESCRIPTOR_NAME = {
+  .abi_version = VLOCK_PLUGIN_ABI_VERSION,
+  .hooks = {
+    [VLOCK_HOOK_SAVE] = ttyblank_save,
+    [VLOCK_HOOK_SAVE_ABORT] = ttyblank_save_abort,
+  },
+  .depends = ttyblank_depends,
+};
@@ -19,17 +19,27 @@
 
 #include "vlock_plugin.h"
 
-const char *depends[] = { "all", NULL };
-const char *conflicts[] = { "blank", NULL };
+static const char *const vesablank_depends[] = { "all", NULL };
+static const char *const vesablank_conflicts[] = { "blank", NULL };
 
-bool vlock_save(void __attribute__ ((__unused__)) ** ctx)
+static bool vesablank_save(void __attribute__ ((__unused__)) ** ctx)
 {
   char arg[] = { TIOCL_SETVESABLANK, 2 };
   return ioctl(STDIN_FILENO, TIOCLINUX, arg) == 0;
 }
 
-bool vlock_save_abort(void __attribute__ ((__unused__)) ** ctx)
+static bool vesablank_save_abort(void __attribute__ ((__unused__)) ** ctx)
 {
   char arg[] = { TIOCL_SETVESABLANK, 0 };
   return ioctl(STDIN_FILENO, TIOCLINUX, arg) == 0;
 }
+
+const struct vlock_plugin_descriptor VLOCK_PLUGIN_DESCRIPTOR_NAME = {
+  .abi_version = VLOCK_PLUGIN_ABI_VERSION,
+  .hooks = {
+    [VLOCK_HOOK_SAVE] = vesablank_save,
+    [VLOCK_HOOK_SAVE_ABORT] = vesablank_save_abort,
+  },
+  .depends = vesablank_depends,
+  .conflicts = vesablank_conflicts,
+};
@@ -12,6 +12,9 @@
  */
 #include <stdbool.h>
 
+/* Version 1 of the module interface: the dependencies and hooks are exported
+ * as separate symbols. */
+
 extern const char *preceeds[];
 extern const char *succeeds[];
 extern const char *requires[];
@@ -23,3 +26,42 @@ bool vlock_start(void **);
 bool vlock_end(void **);
 bool vlock_save(void **);
 bool vlock_save_abort(void **);
+
+/* Version 2 of the module interface: a single descriptor is exported that
+ * contains everything.  If a module defines it the symbols above are
+ * ignored. */
+
+#define VLOCK_PLUGIN_ABI_VERSION 2
+
+/* Indices of the hooks in the descriptor. */
+enum vlock_hook
+{
+  VLOCK_HOOK_START,
+  VLOCK_HOOK_END,
+  VLOCK_HOOK_SAVE,
+  VLOCK_HOOK_SAVE_ABORT,
+  VLOCK_NR_HOOKS
+};
+
+struct vlock_plugin_descriptor
+{
+  /* Must be set to VLOCK_PLUGIN_ABI_VERSION. */
+  unsigned int abi_version;
+  /* Hook functions.  Unimplemented hooks are NULL. */
+  bool (*hooks[VLOCK_NR_HOOKS])(void **);
+  /* NULL terminated dependency arrays.  Empty dependencies may be NULL. */
+  const char *const *succeeds;
+  const char *const *preceeds;
+  const char *const *requires;
+  const char *const *needs;
+  const char *const *depends;
+  const char *const *conflicts;
+};
+
+/* The name of the descriptor.  Modules that are linked into vlock-main are
+ * compiled with a name of their own, see Makefile. */
+#ifndef VLOCK_PLUGIN_DESCRIPTOR_NAME
+#define VLOCK_PLUGIN_DESCRIPTOR_NAME vlock_plugin_descriptor
+#endif
+
+extern const struct vlock_plugin_descriptor VLOCK_PLUGIN_DESCRIPTOR_NAME;
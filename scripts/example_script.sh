@@ -53,6 +53,17 @@ case "$1" in
   hooks)
     hooks
   ;;
+  vlock-protocol-2)
+    echo "VLOCK-PROTOCOL 2"
+    echo "preceeds ${PRECEEDS}"
+    echo "succeeds ${SUCCEEDS}"
+    echo "requires ${REQUIRES}"
+    echo "needs ${NEEDS}"
+    echo "depends ${DEPENDS}"
+    echo "conflicts ${CONFLICTS}"
+    echo "END"
+    hooks > /dev/null
+  ;;
   preceeds)
     echo "${PRECEEDS}"
   ;;
@@ -46,17 +46,58 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <pwd.h>
+#include <pthread.h>
 
 #include <security/pam_appl.h>
 
 #include "auth.h"
-#include "prompt.h"
+#include "list.h"
+#include "trace.h"
+
+/* Size of the buffer for the strings of a password entry. */
+#define PASSWD_BUFFER_SIZE 1024
+
+/* Starting a PAM transaction loads and initializes every module of the stack,
+ * which may be slow, e.g. for network backed stacks.  So a transaction is
+ * started only once for every user and then used for every attempt to
+ * authenticate that user.  All transactions are ended after a successful
+ * attempt or when vlock exits.  A single transaction is ended earlier if the
+ * stack gives up on it, i.e. on any error other than a wrong password.
+ *
+ * auth() and auth_password() run on worker threads, see auth-worker.c, and
+ * auth_password() runs for several users at the same time.  PAM handles must
+ * not be used by several threads at once.  A worker whose attempt timed out
+ * may still be in pam_authenticate() when the next attempt for the same user
+ * starts, which then starts a transaction of its own.  Only one idle
+ * transaction is kept per user.  Transactions that are still in use by a
+ * worker when vlock is unlocked are ended by it. */
+struct transaction
+{
+  char *user;
+  pam_handle_t *pamh;
+  struct pam_conv conv;
+  /* The timeout of the current attempt. */
+  struct timespec *timeout;
+  /* The password of the current attempt if it is not prompted for. */
+  const char *password;
+  /* Set while pam_authenticate() runs. */
+  bool busy;
+};
+
+/* Protects the list of transactions, their busy flags and the unlocked
+ * flag. */
+static pthread_mutex_t transactions_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct list *transactions;
+/* Set once any user was authenticated. */
+static bool unlocked;
 
 static int conversation(int num_msg, const struct pam_message **msg, struct
                         pam_response **resp, void *appdata_ptr)
 {
   struct pam_response *aresp;
-  struct timespec *timeout = appdata_ptr;
+  struct transaction *t = appdata_ptr;
+  struct timespec *timeout = t->timeout;
 
   if (num_msg <= 0 || num_msg > PAM_MAX_NUM_MSG)
     return PAM_CONV_ERR;
@@ -67,12 +108,19 @@ static int conversation(int num_msg, const struct pam_message **msg, struct
   for (int i = 0; i < num_msg; i++) {
     switch (msg[i]->msg_style) {
       case PAM_PROMPT_ECHO_OFF:
-        aresp[i].resp = prompt_echo_off(msg[i]->msg, timeout);
+        if (t->password != NULL)
+          aresp[i].resp = strdup(t->password);
+        else
+          aresp[i].resp = auth_prompt(msg[i]->msg, false, timeout);
         if (aresp[i].resp == NULL)
           goto fail;
         break;
       case PAM_PROMPT_ECHO_ON:
-        aresp[i].resp = prompt(msg[i]->msg, timeout);
+        /* Nothing else than the password can be answered without
+         * prompting. */
+        if (t->password != NULL)
+          goto fail;
+        aresp[i].resp = auth_prompt(msg[i]->msg, true, timeout);
         if (aresp[i].resp == NULL)
           goto fail;
         break;
@@ -108,23 +156,82 @@ fail:
   return PAM_CONV_ERR;
 }
 
-bool auth(const char *user, struct timespec *timeout)
+static void end_transaction(struct transaction *t, int pam_status)
+{
+  int pam_end_status;
+
+  trace_begin("pam_end", t->user);
+  pam_end_status = pam_end(t->pamh, pam_status);
+  trace_end();
+
+  if (pam_end_status != PAM_SUCCESS)
+    fprintf(stderr, "vlock: %s\n", pam_strerror(t->pamh, pam_end_status));
+
+  list_delete(transactions, t);
+  free(t->user);
+  free(t);
+}
+
+/* End all transactions that are not in use.  Must be called with the lock
+ * held. */
+static void end_idle_transactions(void)
+{
+  list_for_each_manual(transactions, item) {
+    struct transaction *t = item->data;
+    item = item->next;
+
+    if (!t->busy)
+      end_transaction(t, PAM_SUCCESS);
+  }
+}
+
+static void end_all_transactions(void)
+{
+  (void) pthread_mutex_lock(&transactions_lock);
+  end_idle_transactions();
+  (void) pthread_mutex_unlock(&transactions_lock);
+}
+
+static struct transaction *start_transaction(const char *user)
 {
+  struct transaction *t;
   char *pam_tty;
-  pam_handle_t *pamh;
   int pam_status;
-  int pam_end_status;
-  struct pam_conv pamc = {
-    .conv = conversation,
-    .appdata_ptr = timeout,
-  };
+
+  if (transactions == NULL) {
+    transactions = list_new();
+
+    if (transactions == NULL || atexit(end_all_transactions) != 0)
+      goto out_of_memory;
+  }
+
+  t = malloc(sizeof *t);
+
+  if (t == NULL)
+    goto out_of_memory;
+
+  t->user = strdup(user);
+  t->timeout = NULL;
+  t->password = NULL;
+  t->busy = false;
+  /* The conversation gets the transaction to find the current timeout. */
+  t->conv.conv = conversation;
+  t->conv.appdata_ptr = t;
+
+  if (t->user == NULL || !list_append(transactions, t)) {
+    free(t->user);
+    free(t);
+    goto out_of_memory;
+  }
 
   /* initialize pam */
-  pam_status = pam_start("vlock", user, &pamc, &pamh);
+  trace_begin("pam_start", user);
+  pam_status = pam_start("vlock", user, &t->conv, &t->pamh);
+  trace_end();
 
   if (pam_status != PAM_SUCCESS) {
-    fprintf(stderr, "vlock: %s\n", pam_strerror(pamh, pam_status));
-    goto end;
+    fprintf(stderr, "vlock: %s\n", pam_strerror(t->pamh, pam_status));
+    goto error;
   }
 
   /* get the name of stdin's tty device, if any */
@@ -132,31 +239,180 @@ bool auth(const char *user, struct timespec *timeout)
 
   /* set PAM_TTY */
   if (pam_tty != NULL) {
-    pam_status = pam_set_item(pamh, PAM_TTY, pam_tty);
+    pam_status = pam_set_item(t->pamh, PAM_TTY, pam_tty);
 
     if (pam_status != PAM_SUCCESS) {
-      fprintf(stderr, "vlock: %s\n", pam_strerror(pamh, pam_status));
-      goto end;
+      fprintf(stderr, "vlock: %s\n", pam_strerror(t->pamh, pam_status));
+      goto error;
     }
   }
 
+  return t;
+
+error:
+  end_transaction(t, pam_status);
+  return NULL;
+
+out_of_memory:
+  fprintf(stderr, "vlock: out of memory\n");
+  return NULL;
+}
+
+/* Find a transaction of the given user other than the given one.  Busy
+ * transactions are only found if busy is true. */
+static struct transaction *find_transaction(const char *user,
+    const struct transaction *other, bool busy)
+{
+  if (transactions != NULL) {
+    list_for_each(transactions, item) {
+      struct transaction *t = item->data;
+
+      if (t != other && (busy || !t->busy) && strcmp(t->user, user) == 0)
+        return t;
+    }
+  }
+
+  return NULL;
+}
+
+/* Get a transaction of the given user that is not in use.  Must be called
+ * with the lock held. */
+static struct transaction *get_transaction(const char *user)
+{
+  struct transaction *t = find_transaction(user, NULL, false);
+
+  if (t == NULL)
+    t = start_transaction(user);
+
+  return t;
+}
+
+/* Authenticate the user within the user's transaction.  If the password is
+ * not NULL it is given to the stack instead of prompting.  A wrong password is
+ * only reported if quiet is false. */
+static bool authenticate_user(const char *user, const char *password,
+    struct timespec *timeout, bool quiet)
+{
+  struct transaction *t;
+  int pam_status;
+
+  (void) pthread_mutex_lock(&transactions_lock);
+
+  t = get_transaction(user);
+
+  if (t != NULL) {
+    t->timeout = timeout;
+    t->password = password;
+    t->busy = true;
+  }
+
+  (void) pthread_mutex_unlock(&transactions_lock);
+
+  if (t == NULL)
+    return false;
+
+  /* authenticate the user */
+  trace_begin("pam_authenticate", user);
+  pam_status = pam_authenticate(t->pamh, 0);
+  trace_end();
+
+  if (pam_status != PAM_SUCCESS && !(quiet && pam_status == PAM_AUTH_ERR))
+    fprintf(stderr, "vlock: %s\n", pam_strerror(t->pamh, pam_status));
+
+  (void) pthread_mutex_lock(&transactions_lock);
+
+  t->busy = false;
+  t->password = NULL;
+
+  if (pam_status == PAM_SUCCESS)
+    unlocked = true;
+
+  /* Once the screen is unlocked no transaction is needed anymore.  Only a
+   * wrong password leaves the transaction usable for the next attempt.
+   * Anything else, like PAM_MAXTRIES, starts over. */
+  if (unlocked)
+    end_idle_transactions();
+  else if (pam_status != PAM_AUTH_ERR)
+    end_transaction(t, pam_status);
+  else if (find_transaction(user, t, true) != NULL)
+    end_transaction(t, PAM_SUCCESS);
+
+  (void) pthread_mutex_unlock(&transactions_lock);
+
+  return pam_status == PAM_SUCCESS;
+}
+
+bool auth(const char *user, struct timespec *timeout)
+{
   /* put the username before the password prompt */
   fprintf(stderr, "%s's ", user);
   fflush(stderr);
-  /* authenticate the user */
-  pam_status = pam_authenticate(pamh, 0);
 
-  if (pam_status != PAM_SUCCESS) {
-    fprintf(stderr, "vlock: %s\n", pam_strerror(pamh, pam_status));
-  }
+  return authenticate_user(user, NULL, timeout, false);
+}
+
+bool auth_password(const char *user, const char *password)
+{
+  return authenticate_user(user, password, NULL, true);
+}
 
-end:
-  /* finish pam */
-  pam_end_status = pam_end(pamh, pam_status);
+/* Started by auth_preload() and never used.  It only keeps the modules of the
+ * stack loaded.  Processes forked later find them loaded when they start
+ * transactions of their own.  Only the process that started it ends it. */
+static pam_handle_t *preloaded_pamh;
+static pid_t preloaded_pid;
 
-  if (pam_end_status != PAM_SUCCESS) {
-    fprintf(stderr, "vlock: %s\n", pam_strerror(pamh, pam_end_status));
+static int no_conversation(int num_msg, const struct pam_message **msg,
+    struct pam_response **resp, void *appdata_ptr)
+{
+  (void) num_msg;
+  (void) msg;
+  (void) resp;
+  (void) appdata_ptr;
+
+  return PAM_CONV_ERR;
+}
+
+static void end_preloaded_transaction(void)
+{
+  if (getpid() == preloaded_pid)
+    (void) pam_end(preloaded_pamh, PAM_SUCCESS);
+}
+
+void auth_preload(const char *user)
+{
+  static const struct pam_conv conv = { no_conversation, NULL };
+  struct passwd pw_buffer;
+  struct passwd *pw;
+  char buffer[PASSWD_BUFFER_SIZE];
+
+  if (preloaded_pamh == NULL) {
+    trace_begin("pam_start", user);
+
+    /* Errors are reported when the stack is actually used. */
+    if (pam_start("vlock", user, &conv, &preloaded_pamh) != PAM_SUCCESS)
+      preloaded_pamh = NULL;
+    else if (atexit(end_preloaded_transaction) == 0)
+      preloaded_pid = getpid();
+
+    trace_end();
   }
 
-  return (pam_status == PAM_SUCCESS);
+  /* Loads the NSS backends, see auth_prepare(). */
+  (void) getpwnam_r(user, &pw_buffer, buffer, sizeof buffer, &pw);
+}
+
+void auth_prepare(const char *user)
+{
+  struct passwd pw_buffer;
+  struct passwd *pw;
+  char buffer[PASSWD_BUFFER_SIZE];
+
+  /* The modules are loaded when the transaction is started. */
+  (void) pthread_mutex_lock(&transactions_lock);
+  (void) get_transaction(user);
+  (void) pthread_mutex_unlock(&transactions_lock);
+
+  /* Most modules look up the user, which loads the NSS backends. */
+  (void) getpwnam_r(user, &pw_buffer, buffer, sizeof buffer, &pw);
 }
@@ -15,7 +15,7 @@
 #define _XOPEN_SOURCE
 
 #ifndef __FreeBSD__
-/* for asprintf() */
+/* for asprintf(), crypt_r() and getspnam_r() */
 #define _GNU_SOURCE
 #endif
 
@@ -24,56 +24,333 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
+#include <pthread.h>
 
-#include <sys/mman.h>
-
+#include <crypt.h>
 #include <shadow.h>
 
 #include "auth.h"
-#include "prompt.h"
+#include "list.h"
+#include "trace.h"
 
-bool auth(const char *user, struct timespec *timeout)
+/* Size of the buffer for the strings of a shadow entry. */
+#define SHADOW_BUFFER_SIZE 1024
+
+/* Set by vlock-main. */
+extern int vlock_debug;
+
+/* Looking up a shadow entry may ask NSS, which may be slow, and the state of
+ * crypt_r() is big.  So both are set up only once for every user and then
+ * used for every attempt to authenticate that user until vlock exits.
+ * Changing the password while the screen is locked has no effect before that.
+ *
+ * auth() and auth_password() run on worker threads, see auth-worker.c, and
+ * auth_password() runs for several users at the same time.  A worker that is
+ * still hashing when the next attempt starts keeps the state, the next attempt
+ * then uses a state of its own.  Users that are in use when vlock exits are
+ * not freed. */
+struct shadow_user
 {
-  char *pwd;
-  char *cryptpw;
-  char *msg;
+  char *user;
+  /* The hashed password from the shadow entry. */
+  char *hash;
+  char *prompt;
+  struct crypt_data *data;
+  /* The number of threads that use the user. */
+  size_t references;
+  /* Set while the data is used by crypt_r(). */
+  bool hashing;
+};
+
+/* Protects the list of users, their references and hashing flags. */
+static pthread_mutex_t users_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct list *users;
+
+static void free_user(struct shadow_user *u)
+{
+  if (u->hash != NULL) {
+    memset(u->hash, 0, strlen(u->hash));
+    free(u->hash);
+  }
+
+  if (u->data != NULL) {
+    memset(u->data, 0, sizeof *u->data);
+    free(u->data);
+  }
+
+  free(u->prompt);
+  free(u->user);
+  free(u);
+}
+
+/* Free all users that are not in use. */
+static void free_users(void)
+{
+  (void) pthread_mutex_lock(&users_lock);
+
+  list_for_each_manual(users, item) {
+    struct shadow_user *u = item->data;
+
+    if (u->references > 0) {
+      item = item->next;
+    } else {
+      item = list_delete_item(users, item);
+      free_user(u);
+    }
+  }
+
+  (void) pthread_mutex_unlock(&users_lock);
+}
+
+static struct shadow_user *new_user(const char *user)
+{
+  struct spwd spw_buffer;
   struct spwd *spw;
-  int result = false;
+  char buffer[SHADOW_BUFFER_SIZE];
+  struct shadow_user *u;
+
+  if (users == NULL) {
+    users = list_new();
+
+    if (users == NULL || atexit(free_users) != 0)
+      goto out_of_memory;
+  }
+
+  /* get the shadow password */
+  trace_begin("getspnam", user);
+
+  if (getspnam_r(user, &spw_buffer, buffer, sizeof buffer, &spw) != 0)
+    spw = NULL;
+
+  trace_end();
+
+  if (spw == NULL) {
+    fprintf(stderr, "vlock: could not get the password of %s\n", user);
+    return NULL;
+  }
+
+  u = calloc(1, sizeof *u);
+
+  if (u == NULL)
+    goto out_of_memory;
+
+  u->user = strdup(user);
+  u->hash = strdup(spw->sp_pwdp);
+  /* crypt_r() keeps its state here instead of in a static buffer. */
+  u->data = calloc(1, sizeof *u->data);
+
+  memset(buffer, 0, sizeof buffer);
 
   /* format the prompt */
-  if (asprintf(&msg, "%s's Password: ", user) < 0)
+  if (asprintf(&u->prompt, "%s's Password: ", user) < 0)
+    u->prompt = NULL;
+
+  if (u->user == NULL || u->hash == NULL || u->data == NULL
+      || u->prompt == NULL || !list_append(users, u)) {
+    free_user(u);
+    goto out_of_memory;
+  }
+
+  return u;
+
+out_of_memory:
+  memset(buffer, 0, sizeof buffer);
+  fprintf(stderr, "vlock: out of memory\n");
+  return NULL;
+}
+
+static struct shadow_user *find_user(const char *user)
+{
+  if (users != NULL) {
+    list_for_each(users, item) {
+      struct shadow_user *u = item->data;
+
+      if (strcmp(u->user, user) == 0)
+        return u;
+    }
+  }
+
+  return new_user(user);
+}
+
+/* Get the given user and take a reference. */
+static struct shadow_user *get_user(const char *user)
+{
+  struct shadow_user *u;
+
+  (void) pthread_mutex_lock(&users_lock);
+
+  u = find_user(user);
+
+  if (u != NULL)
+    u->references++;
+
+  (void) pthread_mutex_unlock(&users_lock);
+
+  return u;
+}
+
+static void put_user(struct shadow_user *u)
+{
+  (void) pthread_mutex_lock(&users_lock);
+  u->references--;
+  (void) pthread_mutex_unlock(&users_lock);
+}
+
+/* The name of the algorithm the given hash was made with. */
+static const char *get_algorithm(const char *hash)
+{
+  static const struct {
+    const char *prefix;
+    const char *name;
+  } algorithms[] = {
+    { "$y$", "yescrypt" },
+    { "$gy$", "gost-yescrypt" },
+    { "$7$", "scrypt" },
+    { "$2b$", "bcrypt" },
+    { "$2a$", "bcrypt" },
+    { "$2y$", "bcrypt" },
+    { "$6$", "sha512crypt" },
+    { "$5$", "sha256crypt" },
+    { "$sha1$", "sha1crypt" },
+    { "$1$", "md5crypt" },
+  };
+
+  /* Locked accounts have no hash at all. */
+  if (hash[0] == '!' || hash[0] == '*')
+    return "no";
+
+  for (size_t i = 0; i < sizeof algorithms / sizeof algorithms[0]; i++)
+    if (strncmp(hash, algorithms[i].prefix, strlen(algorithms[i].prefix)) == 0)
+      return algorithms[i].name;
+
+  return hash[0] == '$' ? "unknown" : "descrypt";
+}
+
+/* Tell how long hashing took, to see whether an attempt is slow because of
+ * the algorithm or because of vlock. */
+static void debug_hash_time(const struct shadow_user *u,
+    const struct timespec *start)
+{
+  struct timespec end;
+
+  (void) clock_gettime(CLOCK_MONOTONIC, &end);
+
+  fprintf(stderr, "vlock: %s hash for %s took %.3f ms\n",
+      get_algorithm(u->hash), u->user,
+      (end.tv_sec - start->tv_sec) * 1e3
+      + (end.tv_nsec - start->tv_nsec) / 1e6);
+}
+
+bool auth_password(const char *user, const char *password)
+{
+  struct shadow_user *u;
+  struct crypt_data *data;
+  struct timespec start;
+  char *cryptpw;
+  bool shared;
+  bool result = false;
+
+  if ((u = get_user(user)) == NULL)
     return false;
 
-  if ((pwd = prompt_echo_off(msg, timeout)) == NULL)
-    goto out_pwd;
+  (void) pthread_mutex_lock(&users_lock);
 
-  /* get the shadow password */
-  if ((spw = getspnam(user)) == NULL)
-    goto out_shadow;
+  shared = !u->hashing;
+  u->hashing = true;
+
+  (void) pthread_mutex_unlock(&users_lock);
+
+  data = shared ? u->data : calloc(1, sizeof *data);
+
+  if (data == NULL) {
+    put_user(u);
+    return false;
+  }
+
+  (void) clock_gettime(CLOCK_MONOTONIC, &start);
+  trace_begin("crypt", get_algorithm(u->hash));
 
   /* hash the password */
-  if ((cryptpw = crypt(pwd, spw->sp_pwdp)) == NULL) {
+  if ((cryptpw = crypt_r(password, u->hash, data)) == NULL)
     perror("vlock: crypt()");
-    goto out_shadow;
-  }
+  else
+    result = (strcmp(cryptpw, u->hash) == 0);
 
-  result = (strcmp(cryptpw, spw->sp_pwdp) == 0);
+  trace_end();
 
-  if (!result) {
-    sleep(1);
-    fprintf(stderr, "vlock: Authentication error\n");
-  }
+  if (vlock_debug)
+    debug_hash_time(u, &start);
+
+  /* Wipe the hash of the password.  The state may be zeroed at any time. */
+  memset(data, 0, sizeof *data);
+
+  if (!shared)
+    free(data);
+
+  (void) pthread_mutex_lock(&users_lock);
 
-out_shadow:
-  /* deallocate shadow resources */
-  endspent();
+  if (shared)
+    u->hashing = false;
+
+  u->references--;
+
+  (void) pthread_mutex_unlock(&users_lock);
+
+  return result;
+}
+
+bool auth(const char *user, struct timespec *timeout)
+{
+  struct shadow_user *u;
+  char *pwd;
+  bool result;
+
+  if ((u = get_user(user)) == NULL)
+    return false;
+
+  pwd = auth_prompt(u->prompt, false, timeout);
+  put_user(u);
+
+  if (pwd == NULL)
+    return false;
+
+  result = auth_password(user, pwd);
+
+  if (!result)
+    fprintf(stderr, "vlock: Authentication error\n");
 
   /* free the password */
+  memset(pwd, 0, strlen(pwd));
   free(pwd);
 
-out_pwd:
-  /* free the prompt */
-  free(msg);
-
   return result;
 }
+
+void auth_prepare(const char *user)
+{
+  /* Looks up the user and loads the hash algorithm. */
+  (void) auth_password(user, "");
+}
+
+void auth_preload(const char *user)
+{
+  struct spwd spw_buffer;
+  struct spwd *spw;
+  char buffer[SHADOW_BUFFER_SIZE];
+  struct crypt_data *data = calloc(1, sizeof *data);
+
+  /* Loads the NSS backends and the hash algorithm like auth_prepare() but
+   * does not keep the entry. */
+  if (data != NULL) {
+    if (getspnam_r(user, &spw_buffer, buffer, sizeof buffer, &spw) == 0
+        && spw != NULL)
+      (void) crypt_r("", spw->sp_pwdp, data);
+
+    memset(data, 0, sizeof *data);
+    free(data);
+  }
+
+  memset(buffer, 0, sizeof buffer);
+}
@@ -0,0 +1,532 @@
+/* auth-worker.c -- authentification on worker threads for vlock,
+ *                  the VT locking program for linux
+ *
+ * This program is copyright (C) 2007 Frank Benkstein, and is free
+ * software which is freely distributable under the terms of the
+ * GNU General Public License version 2, included as the file COPYING in this
+ * distribution.  It is NOT public domain software, and any
+ * redistribution not permitted by the GNU General Public License is
+ * expressly forbidden without prior written permission from
+ * the author.
+ *
+ */
+
+/* Checking a password may take long, e.g. with an expensive hash or a network
+ * backed PAM stack.  The authentification backend therefore runs on worker
+ * threads while the main thread keeps dispatching events, so console switch
+ * requests and signals are still handled.  The terminal and the event loop
+ * belong to the main thread: a worker that needs to prompt hands the prompt
+ * over to it through auth_prompt() and waits for the answer.
+ *
+ * The timeout covers the whole attempt, prompts included.  When it has passed
+ * the main thread stops waiting.  Workers that are still running are left
+ * alone, their prompts fail right away.  The state that is shared with them is
+ * freed by whoever is done with it last. */
+
+#if !defined(__FreeBSD__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "auth.h"
+#include "event.h"
+#include "prompt.h"
+#include "trace.h"
+#include "util.h"
+
+struct attempt
+{
+  pthread_mutex_t lock;
+  pthread_cond_t answered;
+  /* Workers write to this pipe to wake up the main thread. */
+  int wakeup_fds[2];
+  /* The number of running workers plus one for the main thread. */
+  size_t references;
+  /* The number of workers that did not finish yet. */
+  size_t pending;
+  bool success;
+  /* Set when the main thread stopped waiting. */
+  bool cancelled;
+  /* The password for auth_password() or NULL if auth() is used. */
+  char *password;
+  /* The prompt a worker is waiting for. */
+  const char *prompt_msg;
+  bool prompt_echo;
+  bool prompt_requested;
+  bool prompt_answered;
+  char *answer;
+};
+
+struct worker
+{
+  struct attempt *attempt;
+  char user[];
+};
+
+/* The attempt the current thread works for, NULL on the main thread. */
+static __thread struct attempt *current_attempt;
+
+/* The time the last attempt spent checking the password. */
+static struct timespec last_latency;
+
+static void wake_up(struct attempt *a)
+{
+  (void) write(a->wakeup_fds[1], "", 1);
+}
+
+/* Drop a reference.  Must be called with the lock held, which is released. */
+static void release_attempt(struct attempt *a)
+{
+  bool last = (--a->references == 0);
+
+  (void) pthread_mutex_unlock(&a->lock);
+
+  if (!last)
+    return;
+
+  (void) pthread_cond_destroy(&a->answered);
+  (void) pthread_mutex_destroy(&a->lock);
+  (void) close(a->wakeup_fds[0]);
+  (void) close(a->wakeup_fds[1]);
+
+  if (a->password != NULL) {
+    memset(a->password, 0, strlen(a->password));
+    free(a->password);
+  }
+
+  free(a);
+}
+
+static struct attempt *new_attempt(size_t workers, char *password)
+{
+  struct attempt *a = malloc(sizeof *a);
+
+  if (a == NULL)
+    return NULL;
+
+  if (pipe2(a->wakeup_fds, O_CLOEXEC | O_NONBLOCK) < 0) {
+    free(a);
+    return NULL;
+  }
+
+  (void) pthread_mutex_init(&a->lock, NULL);
+  (void) pthread_cond_init(&a->answered, NULL);
+  a->references = workers + 1;
+  a->pending = workers;
+  a->success = false;
+  a->cancelled = false;
+  a->password = password;
+  a->prompt_msg = NULL;
+  a->prompt_echo = false;
+  a->prompt_requested = false;
+  a->prompt_answered = false;
+  a->answer = NULL;
+
+  return a;
+}
+
+static void finish_worker(struct worker *w, bool result)
+{
+  struct attempt *a = w->attempt;
+
+  (void) pthread_mutex_lock(&a->lock);
+
+  a->pending--;
+  a->success |= result;
+  wake_up(a);
+
+  release_attempt(a);
+  free(w);
+}
+
+/* The timeout is applied by the main thread. */
+static bool work(struct worker *w)
+{
+  struct attempt *a = w->attempt;
+
+  if (a->password != NULL)
+    return auth_password(w->user, a->password);
+  else
+    return auth(w->user, NULL);
+}
+
+static void *run_worker(void *argument)
+{
+  struct worker *w = argument;
+  bool result;
+
+  current_attempt = w->attempt;
+  result = work(w);
+  current_attempt = NULL;
+
+  finish_worker(w, result);
+
+  return NULL;
+}
+
+/* Start a detached thread.  Returns false if it could not be created. */
+static bool start_thread(void *(*run)(void *), void *argument)
+{
+  pthread_attr_t attr;
+  pthread_t thread;
+  sigset_t all_signals;
+  sigset_t old_signals;
+  int error = -1;
+
+  /* Signals are only for the main thread. */
+  (void) sigfillset(&all_signals);
+  (void) pthread_sigmask(SIG_BLOCK, &all_signals, &old_signals);
+
+  if (pthread_attr_init(&attr) == 0) {
+    (void) pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    error = pthread_create(&thread, &attr, run, argument);
+    (void) pthread_attr_destroy(&attr);
+  }
+
+  (void) pthread_sigmask(SIG_SETMASK, &old_signals, NULL);
+
+  return error == 0;
+}
+
+/* Start a worker for the given user.  If no thread can be created the work is
+ * done right away. */
+static void start_worker(struct attempt *a, const char *user)
+{
+  size_t length = strlen(user) + 1;
+  struct worker *w = malloc(sizeof *w + length);
+
+  if (w == NULL) {
+    (void) pthread_mutex_lock(&a->lock);
+    a->pending--;
+    release_attempt(a);
+    return;
+  }
+
+  w->attempt = a;
+  memcpy(w->user, user, length);
+
+  /* Prompts are not handed over then. */
+  if (!start_thread(run_worker, w))
+    finish_worker(w, work(w));
+}
+
+static void *run_preparation(void *argument)
+{
+  char *user = argument;
+
+  trace_begin("auth_prepare", user);
+  auth_prepare(user);
+  trace_end();
+  free(user);
+
+  return NULL;
+}
+
+void prepare_authentication(const char *const users[], size_t n)
+{
+  for (size_t i = 0; i < n; i++) {
+    char *user = strdup(users[i]);
+
+    /* The first attempt is just slower otherwise. */
+    if (user != NULL && !start_thread(run_preparation, user))
+      free(user);
+  }
+}
+
+char *auth_prompt(const char *msg, bool echo, struct timespec *timeout)
+{
+  struct attempt *a = current_attempt;
+  char *answer;
+
+  if (a == NULL)
+    return echo ? prompt(msg, timeout) : prompt_echo_off(msg, timeout);
+
+  (void) pthread_mutex_lock(&a->lock);
+
+  /* Only one prompt at a time. */
+  while (a->prompt_requested && !a->cancelled)
+    (void) pthread_cond_wait(&a->answered, &a->lock);
+
+  if (a->cancelled) {
+    (void) pthread_mutex_unlock(&a->lock);
+    return NULL;
+  }
+
+  a->prompt_msg = msg;
+  a->prompt_echo = echo;
+  a->prompt_requested = true;
+  wake_up(a);
+
+  while (!a->prompt_answered && !a->cancelled)
+    (void) pthread_cond_wait(&a->answered, &a->lock);
+
+  answer = a->answer;
+  a->answer = NULL;
+  a->prompt_requested = false;
+  a->prompt_answered = false;
+  (void) pthread_cond_broadcast(&a->answered);
+
+  (void) pthread_mutex_unlock(&a->lock);
+
+  return answer;
+}
+
+struct waiter
+{
+  int fd;
+  bool woken;
+  bool timed_out;
+};
+
+static long long get_nsec(const struct timespec *t)
+{
+  return t->tv_sec * 1000000000LL + t->tv_nsec;
+}
+
+static long long elapsed_nsec(const struct timespec *start)
+{
+  struct timespec now;
+
+  (void) clock_gettime(CLOCK_MONOTONIC, &now);
+
+  return get_nsec(&now) - get_nsec(start);
+}
+
+static void handle_wakeup(void *data)
+{
+  struct waiter *waiter = data;
+  char buffer[64];
+
+  while (read(waiter->fd, buffer, sizeof buffer) > 0)
+    continue;
+
+  waiter->woken = true;
+}
+
+static void handle_deadline(void *data)
+{
+  struct waiter *waiter = data;
+
+  waiter->timed_out = true;
+  waiter->woken = true;
+}
+
+/* Answer the prompt a worker asked for.  Must be called with the lock held,
+ * which is released in the meantime.  Returns false if the prompt failed, which
+ * it already reported. */
+static bool answer_prompt(struct attempt *a, const struct timespec *deadline)
+{
+  struct timespec remaining;
+  struct timespec *timeout = NULL;
+  char *answer = NULL;
+  bool prompted = false;
+
+  (void) pthread_mutex_unlock(&a->lock);
+
+  if (deadline != NULL)
+    timeout = get_remaining(deadline, &remaining) ? &remaining : NULL;
+
+  if (deadline == NULL || timeout != NULL) {
+    prompted = true;
+    trace_begin("prompt", NULL);
+
+    if (a->prompt_echo)
+      answer = prompt(a->prompt_msg, timeout);
+    else
+      answer = prompt_echo_off(a->prompt_msg, timeout);
+
+    trace_end();
+  }
+
+  (void) pthread_mutex_lock(&a->lock);
+
+  a->answer = answer;
+  a->prompt_answered = true;
+  (void) pthread_cond_broadcast(&a->answered);
+
+  return answer != NULL || !prompted;
+}
+
+/* Dispatch events and answer prompts until a worker succeeded, all of them
+ * failed or the deadline (if not NULL) has passed.  The reference of the main
+ * thread is dropped.  The time it took, prompts excluded, is recorded. */
+static bool wait_for_workers(struct attempt *a, const struct timespec *deadline)
+{
+  struct waiter waiter = {
+    .fd = a->wakeup_fds[0],
+    .woken = false,
+    .timed_out = false,
+  };
+  struct event_source *wakeup = event_watch_fd(a->wakeup_fds[0],
+      handle_wakeup, &waiter);
+  struct event_source *timer = NULL;
+  /* A prompt that timed out already said so. */
+  bool reported = false;
+  bool result;
+  struct timespec start;
+  long long prompting = 0;
+  long long latency;
+
+  (void) clock_gettime(CLOCK_MONOTONIC, &start);
+
+  if (deadline != NULL && wakeup != NULL)
+    timer = event_add_deadline(deadline, handle_deadline, &waiter);
+
+  (void) pthread_mutex_lock(&a->lock);
+
+  if (wakeup == NULL || (deadline != NULL && timer == NULL)) {
+    perror("vlock: waiting for authentification failed");
+    goto out;
+  }
+
+  while (!a->success && a->pending > 0 && !waiter.timed_out) {
+    if (a->prompt_requested && !a->prompt_answered) {
+      struct timespec prompt_start;
+
+      (void) clock_gettime(CLOCK_MONOTONIC, &prompt_start);
+      reported |= !answer_prompt(a, deadline);
+      prompting += elapsed_nsec(&prompt_start);
+      continue;
+    }
+
+    (void) pthread_mutex_unlock(&a->lock);
+
+    waiter.woken = false;
+
+    if (!event_loop(&waiter.woken)) {
+      perror("vlock: waiting for authentification failed");
+      (void) pthread_mutex_lock(&a->lock);
+      goto out;
+    }
+
+    (void) pthread_mutex_lock(&a->lock);
+  }
+
+  if (!a->success && a->pending > 0 && waiter.timed_out && !reported)
+    fprintf(stderr, "timeout!\n");
+
+out:
+  result = a->success;
+
+  /* Workers that are still running may not prompt anymore. */
+  a->cancelled = true;
+  (void) pthread_cond_broadcast(&a->answered);
+
+  event_remove(timer);
+  event_remove(wakeup);
+
+  release_attempt(a);
+
+  latency = elapsed_nsec(&start) - prompting;
+  last_latency.tv_sec = latency / 1000000000LL;
+  last_latency.tv_nsec = latency % 1000000000LL;
+
+  return result;
+}
+
+bool authenticate(const char *user, struct timespec *timeout)
+{
+  struct timespec deadline;
+  struct attempt *a = new_attempt(1, NULL);
+  bool result;
+
+  if (a == NULL) {
+    perror("vlock: could not start authentification");
+    return false;
+  }
+
+  if (timeout != NULL)
+    get_deadline(timeout, &deadline);
+
+  trace_begin("authenticate", user);
+
+  start_worker(a, user);
+  result = wait_for_workers(a, timeout != NULL ? &deadline : NULL);
+
+  trace_end();
+
+  return result;
+}
+
+/* Format the prompt, e.g. "user's or root's Password: ". */
+static char *format_prompt(const char *const users[], size_t n)
+{
+  char *msg = NULL;
+  size_t size;
+  FILE *f = open_memstream(&msg, &size);
+
+  if (f == NULL)
+    return NULL;
+
+  for (size_t i = 0; i < n; i++)
+    (void) fprintf(f, "%s%s's", i > 0 ? " or " : "", users[i]);
+
+  (void) fputs(" Password: ", f);
+
+  if (fclose(f) != 0) {
+    free(msg);
+    return NULL;
+  }
+
+  return msg;
+}
+
+bool auth_any(const char *const users[], size_t n, struct timespec *timeout)
+{
+  struct timespec deadline;
+  struct attempt *a;
+  char *msg;
+  char *password;
+  bool result;
+
+  if (timeout != NULL)
+    get_deadline(timeout, &deadline);
+
+  if ((msg = format_prompt(users, n)) == NULL)
+    return false;
+
+  trace_begin("prompt", NULL);
+  password = prompt_echo_off(msg, timeout);
+  trace_end();
+  free(msg);
+
+  if (password == NULL)
+    return false;
+
+  a = new_attempt(n, password);
+
+  if (a == NULL) {
+    perror("vlock: could not start authentification");
+    memset(password, 0, strlen(password));
+    free(password);
+    return false;
+  }
+
+  trace_begin("auth_any", NULL);
+
+  for (size_t i = 0; i < n; i++)
+    start_worker(a, users[i]);
+
+  result = wait_for_workers(a, timeout != NULL ? &deadline : NULL);
+
+  trace_end();
+
+  if (!result)
+    fprintf(stderr, "vlock: Authentication error\n");
+
+  return result;
+}
+
+void get_auth_latency(struct timespec *latency)
+{
+  *latency = last_latency;
+}
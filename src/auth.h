@@ -12,13 +12,63 @@
  */
 
 #include <stdbool.h>
+#include <stddef.h>
 
 /* forward declaration */
 struct timespec;
 
 /* Try to authenticate the user.  When the user is successfully authenticated
  * this function returns true.  When the authentication fails for whatever
- * reason the function returns false.  The timeout is passed to the prompt
- * functions below if they are called.
+ * reason the function returns false.  The timeout is passed to auth_prompt()
+ * below if it is called.
  */
 bool auth(const char *user, struct timespec *timeout);
+
+/* Try to authenticate the user with the given password without prompting.
+ * This function may be called for different users from different threads at
+ * the same time.
+ */
+bool auth_password(const char *user, const char *password);
+
+/* Get ready to authenticate the user without prompting, so that the first
+ * attempt is not slower than the following ones, e.g. by loading modules and
+ * looking up the user.  This function may be called from a different thread
+ * than the others.
+ */
+void auth_prepare(const char *user);
+
+/* Load what authenticating the user needs in any process, e.g. the modules of
+ * the PAM stack, but keep nothing that belongs to the user.  The lock service
+ * calls this once before it forks its clients, so a password that is changed
+ * later still takes effect for the next client.
+ */
+void auth_preload(const char *user);
+
+/* The functions above run on worker threads.  They must prompt through this
+ * function, which shows the prompt from the main thread.  If echo is false the
+ * characters entered are not echoed.  The timeout is only used when not
+ * called from a worker thread.
+ */
+char *auth_prompt(const char *msg, bool echo, struct timespec *timeout);
+
+/* Run auth() for the user on a worker thread.  Events are dispatched until it
+ * returns or the timeout, which covers prompts and verification, has passed.
+ */
+bool authenticate(const char *user, struct timespec *timeout);
+
+/* Prompt for a single password and try to authenticate each of the given
+ * users with it, each on a worker thread of its own.  Returns true as soon as
+ * one of them is authenticated and false if all of them failed or the timeout
+ * has passed.
+ */
+bool auth_any(const char *const users[], size_t n, struct timespec *timeout);
+
+/* Run auth_prepare() for each of the given users on a worker thread of its
+ * own and return right away.
+ */
+void prepare_authentication(const char *const users[], size_t n);
+
+/* Get the time the last call of authenticate() or auth_any() spent checking
+ * the password, prompts excluded.
+ */
+void get_auth_latency(struct timespec *latency);
@@ -0,0 +1,316 @@
+/* backoff.c -- failure backoff for vlock,
+ *              the VT locking program for linux
+ *
+ * This program is copyright (C) 2007 Frank Benkstein, and is free
+ * software which is freely distributable under the terms of the
+ * GNU General Public License version 2, included as the file COPYING in this
+ * distribution.  It is NOT public domain software, and any
+ * redistribution not permitted by the GNU General Public License is
+ * expressly forbidden without prior written permission from
+ * the author.
+ *
+ */
+
+/* After a failed authentication attempt vlock waits before it prompts again
+ * to slow down guessing.  The first failures are free, so that a typo costs
+ * nothing.  After that the delay doubles with every failure up to a limit.
+ * The policy is read from the environment:
+ *
+ *   VLOCK_BACKOFF_FREE     number of failures without a delay (1)
+ *   VLOCK_BACKOFF_DELAY    delay after the first failure that is not free (1)
+ *   VLOCK_BACKOFF_MAX      longest delay in seconds (30)
+ *   VLOCK_BACKOFF_PERSIST  remember the failures across restarts if not empty
+ *
+ * Remembered failures are kept in a state file with one line per user:
+ *
+ *   user TAB failures NEWLINE
+ *
+ * Users without failures have no line.  The file is only trusted if it is
+ * owned by root and not writable by anybody else.  It is only written if
+ * vlock-main runs with root privileges. */
+
+#if !defined(__FreeBSD__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+
+#include "backoff.h"
+#include "util.h"
+
+#define STATE_FILE VLOCK_STATE_DIR "/failures"
+
+#define NSEC_PER_SEC 1000000000ULL
+
+static unsigned long free_failures;
+static uint64_t initial_delay;
+static uint64_t max_delay;
+
+/* The user whose failures are counted, NULL if they are not remembered. */
+static char *state_user;
+static unsigned long failures;
+static uint64_t total_delay;
+
+/* Convert to nanoseconds.  Absurdly long times are cut short. */
+static uint64_t get_nsec(const struct timespec *t)
+{
+  if ((uint64_t) t->tv_sec >= UINT32_MAX)
+    return UINT32_MAX * NSEC_PER_SEC;
+
+  return t->tv_sec * NSEC_PER_SEC + t->tv_nsec;
+}
+
+static void set_timespec(struct timespec *t, uint64_t nsec)
+{
+  t->tv_sec = nsec / NSEC_PER_SEC;
+  t->tv_nsec = nsec % NSEC_PER_SEC;
+}
+
+/* Parse a non-negative number.  Returns false if the string is NULL or
+ * invalid. */
+static bool parse_count(const char *s, unsigned long *count)
+{
+  unsigned long n;
+  char *end;
+
+  if (s == NULL || !isdigit((unsigned char) *s))
+    return false;
+
+  errno = 0;
+  n = strtoul(s, &end, 10);
+
+  if (errno != 0 || *end != '\0')
+    return false;
+
+  *count = n;
+
+  return true;
+}
+
+static uint64_t get_delay(const char *name, time_t fallback)
+{
+  struct timespec delay = { fallback, 0 };
+
+  (void) parse_seconds(getenv(name), &delay);
+
+  return get_nsec(&delay);
+}
+
+/* Open the state file for reading if it can be trusted. */
+static FILE *open_state(void)
+{
+  struct stat st;
+  FILE *f;
+  int fd = open(STATE_FILE, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+
+  if (fd < 0)
+    return NULL;
+
+  if (fstat(fd, &st) < 0
+      || !S_ISREG(st.st_mode)
+      || st.st_uid != 0
+      || (st.st_mode & (S_IWGRP | S_IWOTH)) != 0) {
+    (void) close(fd);
+    return NULL;
+  }
+
+  f = fdopen(fd, "r");
+
+  if (f == NULL)
+    (void) close(fd);
+
+  return f;
+}
+
+/* Get the beginning of the line of the given user. */
+static char *get_key(const char *user)
+{
+  char *key;
+
+  if (asprintf(&key, "%s\t", user) < 0)
+    return NULL;
+
+  return key;
+}
+
+static unsigned long read_failures(const char *key)
+{
+  FILE *f = open_state();
+  char *line = NULL;
+  size_t line_size = 0;
+  size_t key_length = strlen(key);
+  unsigned long n = 0;
+
+  if (f == NULL)
+    return 0;
+
+  while (getline(&line, &line_size, f) > 0) {
+    if (strncmp(line, key, key_length) == 0) {
+      line[strcspn(line, "\n")] = '\0';
+
+      if (!parse_count(line + key_length, &n))
+        n = 0;
+
+      break;
+    }
+  }
+
+  free(line);
+  (void) fclose(f);
+
+  return n;
+}
+
+/* Replace the line of the current user in the state file. */
+static void store_failures(void)
+{
+  char *key;
+  char *tmp_path;
+  FILE *old_state;
+  FILE *new_state;
+  int dir_fd;
+  int fd;
+
+  /* Nobody else may write the state. */
+  if (state_user == NULL || geteuid() != 0)
+    return;
+
+  /* Other instances of vlock-main may update the file at the same time. */
+  dir_fd = open(VLOCK_STATE_DIR, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+
+  if (dir_fd < 0)
+    return;
+
+  if (flock(dir_fd, LOCK_EX) < 0) {
+    (void) close(dir_fd);
+    return;
+  }
+
+  key = get_key(state_user);
+
+  if (key == NULL || asprintf(&tmp_path, "%s.XXXXXX", STATE_FILE) < 0) {
+    free(key);
+    (void) close(dir_fd);
+    return;
+  }
+
+  fd = mkostemp(tmp_path, O_CLOEXEC);
+
+  if (fd < 0)
+    goto out;
+
+  (void) fchmod(fd, 0600);
+
+  new_state = fdopen(fd, "w");
+
+  if (new_state == NULL) {
+    (void) close(fd);
+    (void) unlink(tmp_path);
+    goto out;
+  }
+
+  old_state = open_state();
+
+  if (old_state != NULL) {
+    char *line = NULL;
+    size_t line_size = 0;
+
+    while (getline(&line, &line_size, old_state) > 0)
+      if (strncmp(line, key, strlen(key)) != 0)
+        fputs(line, new_state);
+
+    free(line);
+    (void) fclose(old_state);
+  }
+
+  if (failures > 0)
+    fprintf(new_state, "%s%lu\n", key, failures);
+
+  /* Replace the state atomically. */
+  if (ferror(new_state) | (fclose(new_state) != 0)
+      || rename(tmp_path, STATE_FILE) < 0)
+    (void) unlink(tmp_path);
+
+out:
+  free(tmp_path);
+  free(key);
+  (void) close(dir_fd);
+}
+
+void backoff_init(const char *user)
+{
+  const char *persist = getenv("VLOCK_BACKOFF_PERSIST");
+
+  if (!parse_count(getenv("VLOCK_BACKOFF_FREE"), &free_failures))
+    free_failures = 1;
+
+  initial_delay = get_delay("VLOCK_BACKOFF_DELAY", 1);
+  max_delay = get_delay("VLOCK_BACKOFF_MAX", 30);
+
+  free(state_user);
+  state_user = NULL;
+  failures = 0;
+  total_delay = 0;
+
+  /* Users containing separators cannot be remembered. */
+  if (persist != NULL && *persist != '\0' && strpbrk(user, "\t\n") == NULL) {
+    char *key = get_key(user);
+
+    if (key != NULL) {
+      failures = read_failures(key);
+      free(key);
+    }
+
+    state_user = strdup(user);
+  }
+}
+
+bool backoff_failure(struct timespec *delay)
+{
+  uint64_t nsec = initial_delay;
+
+  failures++;
+  store_failures();
+
+  if (failures <= free_failures)
+    return false;
+
+  /* Double the delay for every failure after the first one that is not free. */
+  for (unsigned long i = failures - free_failures; i > 1 && nsec < max_delay;
+      i--)
+    nsec = nsec > max_delay / 2 ? max_delay : nsec * 2;
+
+  if (nsec > max_delay)
+    nsec = max_delay;
+
+  total_delay += nsec;
+  set_timespec(delay, nsec);
+
+  return true;
+}
+
+void backoff_success(void)
+{
+  if (failures == 0)
+    return;
+
+  failures = 0;
+  store_failures();
+}
+
+void backoff_total(struct timespec *total)
+{
+  set_timespec(total, total_delay);
+}
@@ -0,0 +1,30 @@
+/* backoff.h -- header file for the failure backoff of vlock,
+ *              the VT locking program for linux
+ *
+ * This program is copyright (C) 2007 Frank Benkstein, and is free
+ * software which is freely distributable under the terms of the
+ * GNU General Public License version 2, included as the file COPYING in this
+ * distribution.  It is NOT public domain software, and any
+ * redistribution not permitted by the GNU General Public License is
+ * expressly forbidden without prior written permission from
+ * the author.
+ *
+ */
+
+#include <stdbool.h>
+
+struct timespec;
+
+/* Read the backoff policy from the environment.  If the failures should be
+ * remembered, the ones of the given user are read from the state file. */
+void backoff_init(const char *user);
+
+/* Count a failed authentication attempt and get the delay that should pass
+ * before the next one.  Returns false if there should be none. */
+bool backoff_failure(struct timespec *delay);
+
+/* Forget the failures after a successful authentication attempt. */
+void backoff_success(void);
+
+/* Get the sum of all delays returned by backoff_failure(). */
+void backoff_total(struct timespec *total);
@@ -0,0 +1,196 @@
+/* builtin-order.c -- generate the precomputed order of the builtin modules
+ *                    of vlock, the VT locking program for linux
+ *
+ * This program is copyright (C) 2007 Frank Benkstein, and is free
+ * software which is freely distributable under the terms of the
+ * GNU General Public License version 2, included as the file COPYING in this
+ * distribution.  It is NOT public domain software, and any
+ * redistribution not permitted by the GNU General Public License is
+ * expressly forbidden without prior written permission from
+ * the author.
+ *
+ */
+
+/* The dependencies of the builtin modules are fixed when vlock-main is
+ * built.  This program is linked with the same modules and writes a header
+ * for builtin.c to stdout that contains
+ *
+ *   - the position of each builtin module in a topological sort of all
+ *     builtin modules according to their "preceeds" and "succeeds"
+ *     dependencies, and
+ *   - a table of the builtin modules that conflict with each other.
+ *
+ * Any subset of the builtin modules sorted by their position is then sorted
+ * correctly, too.  Both are indexed like the table in builtin.c. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "list.h"
+#include "tsort.h"
+
+#include "vlock_plugin.h"
+
+#ifndef VLOCK_BUILTIN_MODULES
+#define VLOCK_BUILTIN_MODULES
+#endif
+
+#define BUILTIN(name, restricted) \
+  extern const struct vlock_plugin_descriptor vlock_builtin_##name;
+VLOCK_BUILTIN_MODULES
+#undef BUILTIN
+
+struct builtin_module
+{
+  const char *name;
+  const struct vlock_plugin_descriptor *descriptor;
+};
+
+#define BUILTIN(name, restricted) \
+  { #name, &vlock_builtin_##name },
+static struct builtin_module builtin_modules[] = {
+  VLOCK_BUILTIN_MODULES
+  { NULL, NULL },
+};
+#undef BUILTIN
+
+static const size_t nr_builtin_modules =
+  sizeof builtin_modules / sizeof builtin_modules[0] - 1;
+
+static struct builtin_module *get_builtin(const char *name)
+{
+  for (size_t i = 0; i < nr_builtin_modules; i++)
+    if (strcmp(builtin_modules[i].name, name) == 0)
+      return &builtin_modules[i];
+
+  return NULL;
+}
+
+static void append_edge(struct list *edges, struct builtin_module *p,
+    struct builtin_module *s)
+{
+  struct edge *e = malloc(sizeof *e);
+
+  if (e == NULL || !list_append(edges, e)) {
+    perror("builtin-order");
+    exit(EXIT_FAILURE);
+  }
+
+  e->predecessor = p;
+  e->successor = s;
+}
+
+/* Does the first module declare a conflict with the second one? */
+static bool declares_conflict(struct builtin_module *p,
+    struct builtin_module *q)
+{
+  const char *const *conflicts = p->descriptor->conflicts;
+
+  for (size_t i = 0; conflicts != NULL && conflicts[i] != NULL; i++)
+    if (strcmp(conflicts[i], q->name) == 0)
+      return true;
+
+  return false;
+}
+
+int main(void)
+{
+  struct list *nodes = list_new();
+  struct list *edges = list_new();
+  struct list *sorted;
+  size_t ranks[nr_builtin_modules + 1];
+  size_t rank = 0;
+
+  if (nodes == NULL || edges == NULL) {
+    perror("builtin-order");
+    exit(EXIT_FAILURE);
+  }
+
+  for (size_t i = 0; i < nr_builtin_modules; i++) {
+    struct builtin_module *p = &builtin_modules[i];
+    const char *const *succeeds = p->descriptor->succeeds;
+    const char *const *preceeds = p->descriptor->preceeds;
+
+    if (!list_append(nodes, p)) {
+      perror("builtin-order");
+      exit(EXIT_FAILURE);
+    }
+
+    /* p must come after these */
+    for (size_t j = 0; succeeds != NULL && succeeds[j] != NULL; j++) {
+      struct builtin_module *q = get_builtin(succeeds[j]);
+
+      if (q != NULL)
+        append_edge(edges, q, p);
+    }
+
+    /* p must come before these */
+    for (size_t j = 0; preceeds != NULL && preceeds[j] != NULL; j++) {
+      struct builtin_module *q = get_builtin(preceeds[j]);
+
+      if (q != NULL)
+        append_edge(edges, p, q);
+    }
+  }
+
+  sorted = tsort(nodes, edges);
+
+  if (sorted == NULL) {
+    fprintf(stderr, "builtin-order: circular dependencies detected\n");
+
+    list_for_each(edges, edge_item) {
+      struct edge *e = edge_item->data;
+      struct builtin_module *p = e->predecessor;
+      struct builtin_module *s = e->successor;
+
+      fprintf(stderr, "\t%s\tmust come before\t%s\n", p->name, s->name);
+    }
+
+    exit(EXIT_FAILURE);
+  }
+
+  list_for_each(sorted, sorted_item) {
+    struct builtin_module *p = sorted_item->data;
+    ranks[p - builtin_modules] = rank++;
+  }
+
+  /* The entry for the end of the table. */
+  ranks[nr_builtin_modules] = rank;
+
+  printf("/* builtin_order.h -- generated by builtin-order, do not edit */\n\n");
+
+  printf("/* Position of each builtin module in the precomputed order. */\n");
+  printf("static const size_t builtin_ranks[] = {\n");
+
+  for (size_t i = 0; i < nr_builtin_modules; i++)
+    printf("  %zu, /* %s */\n", ranks[i], builtin_modules[i].name);
+
+  printf("  %zu,\n};\n\n", ranks[nr_builtin_modules]);
+
+  printf("/* Builtin modules that cannot be loaded at the same time. */\n");
+  printf("static const bool builtin_conflict_table[%zu][%zu] = {\n",
+      nr_builtin_modules + 1, nr_builtin_modules + 1);
+
+  for (size_t i = 0; i <= nr_builtin_modules; i++) {
+    printf("  {");
+
+    for (size_t j = 0; j <= nr_builtin_modules; j++) {
+      bool conflict = i < nr_builtin_modules && j < nr_builtin_modules
+        && (declares_conflict(&builtin_modules[i], &builtin_modules[j])
+            || declares_conflict(&builtin_modules[j], &builtin_modules[i]));
+
+      printf(" %s,", conflict ? "true" : "false");
+    }
+
+    printf(" },\n");
+  }
+
+  printf("};\n");
+
+  list_free(sorted);
+  list_free(nodes);
+  list_free(edges);
+
+  return ferror(stdout) || fflush(stdout) != 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,256 @@
+/* builtin.c -- builtin module routines for vlock,
+ *              the VT locking program for linux
+ *
+ * This program is copyright (C) 2007 Frank Benkstein, and is free
+ * software which is freely distributable under the terms of the
+ * GNU General Public License version 2, included as the file COPYING in this
+ * distribution.  It is NOT public domain software, and any
+ * redistribution not permitted by the GNU General Public License is
+ * expressly forbidden without prior written permission from
+ * the author.
+ *
+ */
+
+/* Builtin modules are modules that are linked into vlock-main instead of
+ * being loaded from the module directory.  They must use the descriptor
+ * interface.  Their descriptors are named vlock_builtin_<name> through
+ * VLOCK_PLUGIN_DESCRIPTOR_NAME when they are compiled and they are listed in
+ * VLOCK_BUILTIN_MODULES as
+ *
+ *   BUILTIN(name, restricted)
+ *
+ * where restricted is true if the installed module would only be readable
+ * by the members of VLOCK_GROUP.  Their order and conflicts are computed by
+ * builtin-order when vlock-main is built. */
+
+#if !defined(__FreeBSD__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <grp.h>
+
+#include <sys/types.h>
+
+#include "list.h"
+#include "util.h"
+
+#include "plugin.h"
+#include "builtin.h"
+#include "vlock_plugin.h"
+
+#ifndef VLOCK_BUILTIN_MODULES
+#define VLOCK_BUILTIN_MODULES
+#endif
+
+#define BUILTIN(name, restricted) \
+  extern const struct vlock_plugin_descriptor vlock_builtin_##name;
+VLOCK_BUILTIN_MODULES
+#undef BUILTIN
+
+struct builtin_module
+{
+  const char *name;
+  const struct vlock_plugin_descriptor *descriptor;
+  bool restricted;
+};
+
+#define BUILTIN(name, restricted) \
+  { #name, &vlock_builtin_##name, restricted },
+static const struct builtin_module builtin_modules[] = {
+  VLOCK_BUILTIN_MODULES
+  { NULL, NULL, false },
+};
+#undef BUILTIN
+
+#include "builtin_order.h"
+
+static bool init_builtin(struct plugin *p);
+static void destroy_builtin(struct plugin *p);
+static bool call_builtin_hook(struct plugin *p, size_t hook);
+static bool check_builtin(struct plugin *p);
+
+struct plugin_type *builtin = &(struct plugin_type){
+  .init = init_builtin,
+  .destroy = destroy_builtin,
+  .call_hook = call_builtin_hook,
+  .check = check_builtin,
+};
+
+struct builtin_context
+{
+  const struct builtin_module *module;
+  /* Pointer to be used by the module. */
+  void *module_data;
+};
+
+/* Check whether the real user may use a restricted module, i.e. would be
+ * able to read it from the module directory. */
+static bool is_permitted(void)
+{
+  struct group *grp;
+  gid_t *groups;
+  int nr_groups;
+  bool result = false;
+
+  if (getuid() == 0)
+    return true;
+
+  grp = getgrnam(VLOCK_GROUP);
+
+  if (grp == NULL)
+    goto denied;
+
+  if (getgid() == grp->gr_gid)
+    return true;
+
+  nr_groups = getgroups(0, NULL);
+
+  if (nr_groups <= 0)
+    goto denied;
+
+  groups = calloc(nr_groups, sizeof *groups);
+
+  if (groups == NULL)
+    return false;
+
+  nr_groups = getgroups(nr_groups, groups);
+
+  for (int i = 0; i < nr_groups && !result; i++)
+    result = (groups[i] == grp->gr_gid);
+
+  free(groups);
+
+  if (result)
+    return true;
+
+denied:
+  errno = EACCES;
+  return false;
+}
+
+static bool init_builtin(struct plugin *p)
+{
+  const struct builtin_module *module = NULL;
+  struct builtin_context *context;
+
+  for (size_t i = 0; builtin_modules[i].name != NULL; i++)
+    if (strcmp(builtin_modules[i].name, p->name) == 0) {
+      module = &builtin_modules[i];
+      break;
+    }
+
+  if (module == NULL) {
+    errno = ENOENT;
+    return false;
+  }
+
+  /* See init_module(). */
+  if (module->restricted && !is_permitted())
+    return false;
+
+  context = malloc(sizeof *context);
+
+  if (context == NULL)
+    return false;
+
+  context->module = module;
+  context->module_data = NULL;
+
+  p->context = context;
+
+  for (size_t i = 0; i < nr_dependencies; i++) {
+    const struct vlock_plugin_descriptor *descriptor = module->descriptor;
+    const char *const *dependency;
+
+    /* In the order of dependency_names. */
+    switch (i) {
+      case 0: dependency = descriptor->succeeds; break;
+      case 1: dependency = descriptor->preceeds; break;
+      case 2: dependency = descriptor->requires; break;
+      case 3: dependency = descriptor->needs; break;
+      case 4: dependency = descriptor->depends; break;
+      default: dependency = descriptor->conflicts; break;
+    }
+
+    for (size_t j = 0; dependency != NULL && dependency[j] != NULL; j++) {
+      char *s = strdup(dependency[j]);
+
+      if (s == NULL || !list_append(p->dependencies[i], s)) {
+        free(s);
+        errno = ENOMEM;
+        return false;
+      }
+    }
+  }
+
+  return true;
+}
+
+static void destroy_builtin(struct plugin *p)
+{
+  free(p->context);
+}
+
+static bool call_builtin_hook(struct plugin *p, size_t hook)
+{
+  struct builtin_context *context = p->context;
+  bool (*hook_function)(void **) = context->module->descriptor->hooks[hook];
+
+  if (hook_function != NULL)
+    return hook_function(&context->module_data);
+
+  return true;
+}
+
+static bool check_builtin(struct plugin *p)
+{
+  struct builtin_context *context = p->context;
+
+  return !context->module->restricted || is_permitted();
+}
+
+/* Get the index of the module of the given builtin plugin. */
+static size_t get_index(struct plugin *p)
+{
+  struct builtin_context *context = p->context;
+
+  return context->module - builtin_modules;
+}
+
+size_t get_builtin_rank(struct plugin *p)
+{
+  return builtin_ranks[get_index(p)];
+}
+
+bool find_builtin_conflict(struct list *plugins, struct plugin **p,
+    struct plugin **q)
+{
+  /* The table has an entry for the end of builtin_modules, too. */
+  size_t n = sizeof builtin_modules / sizeof builtin_modules[0];
+  struct plugin *loaded[n];
+
+  for (size_t i = 0; i < n; i++)
+    loaded[i] = NULL;
+
+  list_for_each(plugins, plugin_item)
+    loaded[get_index(plugin_item->data)] = plugin_item->data;
+
+  for (size_t i = 0; i < n; i++) {
+    if (loaded[i] == NULL)
+      continue;
+
+    for (size_t j = i + 1; j < n; j++) {
+      if (loaded[j] != NULL && builtin_conflict_table[i][j]) {
+        *p = loaded[i];
+        *q = loaded[j];
+        return true;
+      }
+    }
+  }
+
+  return false;
+}
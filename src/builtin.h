@@ -0,0 +1,30 @@
+/* builtin.h -- header file for the builtin module routines of vlock,
+ *              the VT locking program for linux
+ *
+ * This program is copyright (C) 2007 Frank Benkstein, and is free
+ * software which is freely distributable under the terms of the
+ * GNU General Public License version 2, included as the file COPYING in this
+ * distribution.  It is NOT public domain software, and any
+ * redistribution not permitted by the GNU General Public License is
+ * expressly forbidden without prior written permission from
+ * the author.
+ *
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+
+struct list;
+struct plugin;
+
+/* Get the position of the given builtin plugin in the order of all builtin
+ * modules that was computed when vlock-main was built.  Sorting any set of
+ * builtin plugins by their positions satisfies their "preceeds" and
+ * "succeeds" dependencies. */
+size_t get_builtin_rank(struct plugin *p);
+
+/* Look up the given list of builtin plugins in the table of conflicts that
+ * was computed when vlock-main was built.  If two of them conflict with each
+ * other they are stored in p and q and true is returned. */
+bool find_builtin_conflict(struct list *plugins, struct plugin **p,
+    struct plugin **q);
@@ -31,13 +31,14 @@
 #endif
 
 #include "console_switch.h"
+#include "event.h"
 
 /* Is console switching currently disabled? */
 bool console_switch_locked = false;
 
 /* This handler is called whenever a user tries to
  * switch away from this virtual console. */
-static void release_vt(int __attribute__ ((__unused__)) signum)
+static void release_vt(void __attribute__ ((__unused__)) *data)
 {
   /* Deny console switch. */
   (void) ioctl(STDIN_FILENO, VT_RELDISP, 0);
@@ -45,7 +46,7 @@ static void release_vt(int __attribute__ ((__unused__)) signum)
 
 /* This handler is called whenever a user switches to this
  * virtual console. */
-static void acquire_vt(int __attribute__ ((__unused__)) signum)
+static void acquire_vt(void __attribute__ ((__unused__)) *data)
 {
   /* Acknowledge console switch. */
   (void) ioctl(STDIN_FILENO, VT_RELDISP, VT_ACKACQ);
@@ -53,9 +54,17 @@ static void acquire_vt(int __attribute__ ((__unused__)) signum)
 
 /* Console mode before switching was disabled. */
 static struct vt_mode vtm;
-/* Signal actions before console handling was disabled. */
-static struct sigaction sa_usr1;
-static struct sigaction sa_usr2;
+/* The release and acquire signals are read by the event loop. */
+static struct event_source *release_source;
+static struct event_source *acquire_source;
+
+static void unwatch_signals(void)
+{
+  event_remove(release_source);
+  event_remove(acquire_source);
+  release_source = NULL;
+  acquire_source = NULL;
+}
 
 /* Disable virtual console switching in the kernel.  If disabling fails false
  * is returned and errno is set. */
@@ -63,7 +72,6 @@ bool lock_console_switch(void)
 {
   /* Console mode when switching is disabled. */
   struct vt_mode lock_vtm;
-  struct sigaction sa;
 
   /* Get the virtual console mode. */
   if (ioctl(STDIN_FILENO, VT_GETMODE, &vtm) < 0) {
@@ -79,12 +87,15 @@ bool lock_console_switch(void)
   /* Copy the current virtual console mode. */
   lock_vtm = vtm;
 
-  (void) sigemptyset(&(sa.sa_mask));
-  sa.sa_flags = SA_RESTART;
-  sa.sa_handler = release_vt;
-  (void) sigaction(SIGUSR1, &sa, &sa_usr1);
-  sa.sa_handler = acquire_vt;
-  (void) sigaction(SIGUSR2, &sa, &sa_usr2);
+  release_source = event_watch_signal(SIGUSR1, release_vt, NULL);
+  acquire_source = event_watch_signal(SIGUSR2, acquire_vt, NULL);
+
+  if (release_source == NULL || acquire_source == NULL) {
+    perror("vlock: could not watch console switch signals");
+    unwatch_signals();
+    errno = 0;
+    return false;
+  }
 
   /* Set terminal switching to be process governed. */
   lock_vtm.mode = VT_PROCESS;
@@ -97,13 +108,11 @@ bool lock_console_switch(void)
   lock_vtm.frsig = SIGHUP;
 
   /* Set virtual console mode to be process governed thus disabling console
-   * switching through the signal handlers above. */
+   * switching through the handlers above. */
   if (ioctl(STDIN_FILENO, VT_SETMODE, &lock_vtm) < 0) {
     perror("vlock: disabling console switching failed");
 
-    /* Reset signal handlers. */
-    (void) sigaction(SIGUSR1, &sa_usr1, NULL);
-    (void) sigaction(SIGUSR2, &sa_usr2, NULL);
+    unwatch_signals();
     errno = 0;
     return false;
   }
@@ -116,10 +125,7 @@ bool lock_console_switch(void)
 bool unlock_console_switch(void)
 {
   if (ioctl(STDIN_FILENO, VT_SETMODE, &vtm) == 0) {
-    /* Reset signal handlers. */
-    (void) sigaction(SIGUSR1, &sa_usr1, NULL);
-    (void) sigaction(SIGUSR2, &sa_usr2, NULL);
-
+    unwatch_signals();
     return true;
   } else {
     perror("vlock: reenabling console switch failed");
@@ -0,0 +1,739 @@
+/* event.c -- event loop for vlock,
+ *            the VT locking program for linux
+ *
+ * This program is copyright (C) 2007 Frank Benkstein, and is free
+ * software which is freely distributable under the terms of the
+ * GNU General Public License version 2, included as the file COPYING in this
+ * distribution.  It is NOT public domain software, and any
+ * redistribution not permitted by the GNU General Public License is
+ * expressly forbidden without prior written permission from
+ * the author.
+ *
+ */
+
+/* Everything vlock-main waits for goes through a single epoll instance:
+ * input on the terminal, output of scripts, signals (through a signalfd),
+ * timeouts (through timerfds) and the death of child processes (through
+ * pidfds).  Nothing is done from asynchronous signal handlers.
+ *
+ * Only one event is taken from the epoll instance at a time, so a handler may
+ * remove any source, including its own, without the loop ever seeing a stale
+ * pointer.
+ *
+ * Other systems, e.g. FreeBSD, have none of these.  There the loop calls
+ * poll() for the descriptors and keeps the deadlines of the timers itself.
+ * Signals are caught by a handler that only notes them and writes to a pipe
+ * to wake up poll().  Children cannot be watched, like on kernels without
+ * pidfds. */
+
+#if !defined(__FreeBSD__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <signal.h>
+#include <errno.h>
+#include <time.h>
+
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/syscall.h>
+#include <sys/timerfd.h>
+#else
+#include <limits.h>
+#include <fcntl.h>
+#include <poll.h>
+#endif
+
+#include "event.h"
+#include "list.h"
+#include "util.h"
+
+enum event_type
+{
+  EVENT_FD,
+  EVENT_SIGNAL,
+  EVENT_TIMER,
+  EVENT_CHILD,
+};
+
+struct event_source
+{
+  enum event_type type;
+  /* The descriptor that is registered with the epoll instance.  -1 for
+   * signals, which share the signalfd, and for timers without timerfds. */
+  int fd;
+  /* The signal of a signal source. */
+  int signum;
+#ifndef __linux__
+  /* The action of the signal before it was watched. */
+  struct sigaction old_action;
+  /* When the timer expires and whether it was not dispatched yet. */
+  struct timespec deadline;
+  bool armed;
+#endif
+  event_handler handler;
+  void *data;
+};
+
+/* All sources. */
+static struct list *sources;
+
+static bool watch_descriptor(int fd, struct event_source *source);
+
+static struct event_source *new_source(enum event_type type, int fd,
+    event_handler handler, void *data)
+{
+  struct event_source *source;
+
+  if (sources == NULL) {
+    sources = list_new();
+
+    if (sources == NULL)
+      return NULL;
+  }
+
+  source = malloc(sizeof *source);
+
+  if (source == NULL)
+    return NULL;
+
+  source->type = type;
+  source->fd = fd;
+  source->signum = 0;
+  source->handler = handler;
+  source->data = data;
+
+  if ((fd >= 0 && !watch_descriptor(fd, source))
+      || !list_append(sources, source)) {
+    GUARD_ERRNO(free(source));
+    return NULL;
+  }
+
+  return source;
+}
+
+struct event_source *event_watch_fd(int fd, event_handler handler, void *data)
+{
+  return new_source(EVENT_FD, fd, handler, data);
+}
+
+struct event_source *event_add_timer(const struct timespec *timeout,
+    event_handler handler, void *data)
+{
+  struct timespec deadline;
+
+  get_deadline(timeout, &deadline);
+
+  return event_add_deadline(&deadline, handler, data);
+}
+
+static void set_done(void *data)
+{
+  bool *done = data;
+  *done = true;
+}
+
+bool event_sleep(const struct timespec *timeout)
+{
+  bool done = false;
+  struct event_source *timer = event_add_timer(timeout, set_done, &done);
+  bool result;
+
+  if (timer == NULL)
+    return false;
+
+  result = event_loop(&done);
+  GUARD_ERRNO(event_remove(timer));
+
+  return result;
+}
+
+#ifdef __linux__
+
+/* The epoll instance. */
+static int epoll_fd = -1;
+/* The signalfd for all watched signals and the signals it reads. */
+static int signal_fd = -1;
+static sigset_t watched_signals;
+
+static int get_epoll_fd(void)
+{
+  if (epoll_fd < 0)
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+
+  return epoll_fd;
+}
+
+/* Register the given descriptor with the epoll instance.  The signalfd is
+ * registered with a NULL source. */
+static bool add_to_epoll(int fd, struct event_source *source)
+{
+  struct epoll_event event = {
+    .events = EPOLLIN,
+    .data.ptr = source,
+  };
+
+  if (get_epoll_fd() < 0)
+    return false;
+
+  return epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event) == 0;
+}
+
+static bool watch_descriptor(int fd, struct event_source *source)
+{
+  return add_to_epoll(fd, source);
+}
+
+struct event_source *event_watch_signal(int signum, event_handler handler,
+    void *data)
+{
+  struct event_source *source;
+  sigset_t signals;
+  int fd;
+
+  if (signal_fd < 0)
+    (void) sigemptyset(&watched_signals);
+
+  /* Every signal may only be watched once. */
+  if (sigismember(&watched_signals, signum) == 1) {
+    errno = EBUSY;
+    return NULL;
+  }
+
+  (void) sigemptyset(&signals);
+  (void) sigaddset(&signals, signum);
+  (void) sigaddset(&watched_signals, signum);
+
+  /* The signal must be blocked or it would be delivered the normal way. */
+  if (sigprocmask(SIG_BLOCK, &signals, NULL) < 0)
+    goto error;
+
+  fd = signalfd(signal_fd, &watched_signals, SFD_CLOEXEC | SFD_NONBLOCK);
+
+  if (fd < 0)
+    goto error;
+
+  if (signal_fd < 0) {
+    signal_fd = fd;
+
+    if (!add_to_epoll(signal_fd, NULL))
+      goto error;
+  }
+
+  source = new_source(EVENT_SIGNAL, -1, handler, data);
+
+  if (source == NULL)
+    goto error;
+
+  source->signum = signum;
+
+  return source;
+
+error:
+  GUARD_ERRNO(
+    (void) sigdelset(&watched_signals, signum);
+    (void) sigprocmask(SIG_UNBLOCK, &signals, NULL)
+  );
+  return NULL;
+}
+
+/* Timers expire at a deadline on CLOCK_MONOTONIC, see get_deadline(). */
+static bool set_timer(int fd, const struct timespec *deadline)
+{
+  struct itimerspec value = {
+    .it_interval = { 0, 0 },
+    .it_value = *deadline,
+  };
+
+  return timerfd_settime(fd, TFD_TIMER_ABSTIME, &value, NULL) == 0;
+}
+
+struct event_source *event_add_deadline(const struct timespec *deadline,
+    event_handler handler, void *data)
+{
+  struct event_source *source;
+  int fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+
+  if (fd < 0)
+    return NULL;
+
+  if (!set_timer(fd, deadline)) {
+    GUARD_ERRNO((void) close(fd));
+    return NULL;
+  }
+
+  source = new_source(EVENT_TIMER, fd, handler, data);
+
+  if (source == NULL)
+    GUARD_ERRNO((void) close(fd));
+
+  return source;
+}
+
+bool event_reset_timer(struct event_source *timer,
+    const struct timespec *timeout)
+{
+  struct timespec deadline;
+  uint64_t expirations;
+
+  /* Forget an expiration that was not dispatched yet. */
+  (void) read(timer->fd, &expirations, sizeof expirations);
+
+  get_deadline(timeout, &deadline);
+
+  return set_timer(timer->fd, &deadline);
+}
+
+struct event_source *event_watch_child(pid_t pid, event_handler handler,
+    void *data)
+{
+#ifdef SYS_pidfd_open
+  struct event_source *source;
+  int fd = syscall(SYS_pidfd_open, pid, 0);
+
+  if (fd < 0)
+    return NULL;
+
+  /* The close-on-exec flag is always set. */
+  source = new_source(EVENT_CHILD, fd, handler, data);
+
+  if (source == NULL)
+    GUARD_ERRNO((void) close(fd));
+
+  return source;
+#else
+  (void) pid;
+  (void) handler;
+  (void) data;
+  errno = ENOSYS;
+  return NULL;
+#endif
+}
+
+/* Stop watching the given signal.  Signals that arrived in the meantime are
+ * discarded so that unblocking does not deliver them. */
+static void unwatch_signal(int signum)
+{
+  struct timespec zero = { 0, 0 };
+  sigset_t signals;
+
+  (void) sigdelset(&watched_signals, signum);
+  (void) signalfd(signal_fd, &watched_signals, SFD_CLOEXEC | SFD_NONBLOCK);
+
+  (void) sigemptyset(&signals);
+  (void) sigaddset(&signals, signum);
+
+  while (sigtimedwait(&signals, NULL, &zero) == signum)
+    continue;
+
+  (void) sigprocmask(SIG_UNBLOCK, &signals, NULL);
+}
+
+void event_remove(struct event_source *source)
+{
+  if (source == NULL)
+    return;
+
+  list_delete(sources, source);
+
+  if (source->type == EVENT_SIGNAL) {
+    unwatch_signal(source->signum);
+  } else {
+    (void) epoll_ctl(epoll_fd, EPOLL_CTL_DEL, source->fd, NULL);
+
+    if (source->type != EVENT_FD)
+      (void) close(source->fd);
+  }
+
+  free(source);
+}
+
+/* Read one signal from the signalfd and call the handler that watches it. */
+static void dispatch_signal(void)
+{
+  struct signalfd_siginfo info;
+
+  if (read(signal_fd, &info, sizeof info) != sizeof info)
+    return;
+
+  list_for_each(sources, source_item) {
+    struct event_source *source = source_item->data;
+
+    if (source->type == EVENT_SIGNAL && source->signum == (int) info.ssi_signo) {
+      source->handler(source->data);
+      break;
+    }
+  }
+}
+
+static void dispatch(struct event_source *source)
+{
+  uint64_t expirations;
+
+  switch (source->type) {
+    case EVENT_TIMER:
+      /* The timer may have been reset after it expired. */
+      if (read(source->fd, &expirations, sizeof expirations) != sizeof expirations)
+        return;
+      break;
+    case EVENT_CHILD:
+      /* A pidfd stays readable after the child died.  It is reported only
+       * once. */
+      (void) epoll_ctl(epoll_fd, EPOLL_CTL_DEL, source->fd, NULL);
+      break;
+    default:
+      break;
+  }
+
+  source->handler(source->data);
+}
+
+bool event_loop(const bool *done)
+{
+  while (!*done) {
+    struct epoll_event event;
+
+    if (get_epoll_fd() < 0)
+      return false;
+
+    if (epoll_wait(epoll_fd, &event, 1, -1) < 0) {
+      if (errno == EINTR)
+        continue;
+
+      return false;
+    }
+
+    if (event.data.ptr == NULL)
+      dispatch_signal();
+    else
+      dispatch(event.data.ptr);
+  }
+
+  return true;
+}
+
+bool event_after_fork(void)
+{
+  if (epoll_fd < 0)
+    return true;
+
+  (void) close(epoll_fd);
+  epoll_fd = -1;
+
+  if (signal_fd >= 0 && !add_to_epoll(signal_fd, NULL))
+    return false;
+
+  if (sources != NULL) {
+    list_for_each(sources, source_item) {
+      struct event_source *source = source_item->data;
+
+      if (source->fd >= 0 && !add_to_epoll(source->fd, source))
+        return false;
+    }
+  }
+
+  return true;
+}
+
+#else /* !__linux__ */
+
+/* The signal handler writes to the pipe to wake up poll(). */
+static int signal_pipe[2] = { -1, -1 };
+/* Signals that were caught but not dispatched yet. */
+static volatile sig_atomic_t pending_signals[NSIG];
+
+/* Descriptors are collected for every call of poll(). */
+static bool watch_descriptor(int fd, struct event_source *source)
+{
+  (void) fd;
+  (void) source;
+
+  return true;
+}
+
+static void note_signal(int signum)
+{
+  int errsv = errno;
+
+  pending_signals[signum] = 1;
+  (void) write(signal_pipe[1], "", 1);
+
+  errno = errsv;
+}
+
+static bool open_signal_pipe(void)
+{
+  if (signal_pipe[0] >= 0)
+    return true;
+
+  return pipe2(signal_pipe, O_CLOEXEC | O_NONBLOCK) == 0;
+}
+
+static struct event_source *find_signal_source(int signum)
+{
+  if (sources != NULL) {
+    list_for_each(sources, source_item) {
+      struct event_source *source = source_item->data;
+
+      if (source->type == EVENT_SIGNAL && source->signum == signum)
+        return source;
+    }
+  }
+
+  return NULL;
+}
+
+struct event_source *event_watch_signal(int signum, event_handler handler,
+    void *data)
+{
+  struct event_source *source;
+  struct sigaction sa;
+  sigset_t signals;
+
+  if (signum <= 0 || signum >= NSIG) {
+    errno = EINVAL;
+    return NULL;
+  }
+
+  /* Every signal may only be watched once. */
+  if (find_signal_source(signum) != NULL) {
+    errno = EBUSY;
+    return NULL;
+  }
+
+  if (!open_signal_pipe())
+    return NULL;
+
+  source = new_source(EVENT_SIGNAL, -1, handler, data);
+
+  if (source == NULL)
+    return NULL;
+
+  source->signum = signum;
+  pending_signals[signum] = 0;
+
+  (void) sigemptyset(&sa.sa_mask);
+  sa.sa_flags = SA_RESTART;
+  sa.sa_handler = note_signal;
+
+  if (sigaction(signum, &sa, &source->old_action) < 0) {
+    GUARD_ERRNO(list_delete(sources, source); free(source));
+    return NULL;
+  }
+
+  /* The handler must be able to run. */
+  (void) sigemptyset(&signals);
+  (void) sigaddset(&signals, signum);
+  (void) sigprocmask(SIG_UNBLOCK, &signals, NULL);
+
+  return source;
+}
+
+struct event_source *event_add_deadline(const struct timespec *deadline,
+    event_handler handler, void *data)
+{
+  struct event_source *source = new_source(EVENT_TIMER, -1, handler, data);
+
+  if (source != NULL) {
+    source->deadline = *deadline;
+    source->armed = true;
+  }
+
+  return source;
+}
+
+bool event_reset_timer(struct event_source *timer,
+    const struct timespec *timeout)
+{
+  get_deadline(timeout, &timer->deadline);
+  timer->armed = true;
+
+  return true;
+}
+
+struct event_source *event_watch_child(pid_t pid, event_handler handler,
+    void *data)
+{
+  (void) pid;
+  (void) handler;
+  (void) data;
+  errno = ENOSYS;
+  return NULL;
+}
+
+void event_remove(struct event_source *source)
+{
+  if (source == NULL)
+    return;
+
+  list_delete(sources, source);
+
+  /* A signal that was caught in the meantime is forgotten. */
+  if (source->type == EVENT_SIGNAL) {
+    (void) sigaction(source->signum, &source->old_action, NULL);
+    pending_signals[source->signum] = 0;
+  }
+
+  free(source);
+}
+
+/* Call the handler of one signal that was caught.  Returns false if there is
+ * none. */
+static bool dispatch_signal(void)
+{
+  list_for_each(sources, source_item) {
+    struct event_source *source = source_item->data;
+
+    if (source->type == EVENT_SIGNAL && pending_signals[source->signum]) {
+      pending_signals[source->signum] = 0;
+      source->handler(source->data);
+      return true;
+    }
+  }
+
+  return false;
+}
+
+static bool is_earlier(const struct timespec *a, const struct timespec *b)
+{
+  return a->tv_sec < b->tv_sec
+    || (a->tv_sec == b->tv_sec && a->tv_nsec < b->tv_nsec);
+}
+
+/* Call the handler of the first timer that expired.  Otherwise store the
+ * number of milliseconds until the next timer expires, or -1 if there is
+ * none, and return false. */
+static bool dispatch_timer(int *timeout)
+{
+  struct event_source *next = NULL;
+  struct timespec remaining;
+
+  list_for_each(sources, source_item) {
+    struct event_source *source = source_item->data;
+
+    if (source->type == EVENT_TIMER && source->armed
+        && (next == NULL || is_earlier(&source->deadline, &next->deadline)))
+      next = source;
+  }
+
+  *timeout = -1;
+
+  if (next == NULL)
+    return false;
+
+  if (get_remaining(&next->deadline, &remaining)) {
+    /* Round up, poll() must not return before the deadline. */
+    if (remaining.tv_sec >= INT_MAX / 1000 - 1)
+      *timeout = INT_MAX;
+    else
+      *timeout = remaining.tv_sec * 1000
+        + (remaining.tv_nsec + 999999) / 1000000;
+
+    return false;
+  }
+
+  next->armed = false;
+  next->handler(next->data);
+
+  return true;
+}
+
+/* Wait until a descriptor becomes ready, a signal is caught or the timeout
+ * in milliseconds passes.  Calls the handler of at most one descriptor. */
+static bool poll_descriptors(int timeout)
+{
+  size_t n = 1;
+
+  list_for_each(sources, source_item) {
+    struct event_source *source = source_item->data;
+
+    if (source->fd >= 0)
+      n++;
+  }
+
+  /* The first entry is the signal pipe.  poll() ignores it if it is -1. */
+  struct pollfd fds[n];
+  struct event_source *fd_sources[n];
+  size_t i = 1;
+
+  fds[0].fd = signal_pipe[0];
+  fds[0].events = POLLIN;
+
+  list_for_each(sources, source_item) {
+    struct event_source *source = source_item->data;
+
+    if (source->fd >= 0) {
+      fds[i].fd = source->fd;
+      fds[i].events = POLLIN;
+      fd_sources[i] = source;
+      i++;
+    }
+  }
+
+  if (poll(fds, n, timeout) < 0)
+    return errno == EINTR;
+
+  /* The signals themselves were noted by the handler. */
+  if (fds[0].revents != 0) {
+    char buffer[64];
+
+    while (read(signal_pipe[0], buffer, sizeof buffer) > 0)
+      continue;
+
+    return true;
+  }
+
+  for (i = 1; i < n; i++)
+    if (fds[i].revents != 0) {
+      fd_sources[i]->handler(fd_sources[i]->data);
+      break;
+    }
+
+  return true;
+}
+
+bool event_loop(const bool *done)
+{
+  if (sources == NULL) {
+    sources = list_new();
+
+    if (sources == NULL)
+      return false;
+  }
+
+  while (!*done) {
+    int timeout;
+
+    if (dispatch_signal() || dispatch_timer(&timeout))
+      continue;
+
+    if (!poll_descriptors(timeout))
+      return false;
+  }
+
+  return true;
+}
+
+bool event_after_fork(void)
+{
+  int old_pipe[2] = { signal_pipe[0], signal_pipe[1] };
+
+  if (old_pipe[0] < 0)
+    return true;
+
+  /* A signal caught by the child must not wake up the parent or the other
+   * way around. */
+  if (pipe2(signal_pipe, O_CLOEXEC | O_NONBLOCK) < 0)
+    return false;
+
+  (void) close(old_pipe[0]);
+  (void) close(old_pipe[1]);
+
+  return true;
+}
+
+#endif /* !__linux__ */
@@ -0,0 +1,72 @@
+/* event.h -- header file for the event loop of vlock,
+ *            the VT locking program for linux
+ *
+ * This program is copyright (C) 2007 Frank Benkstein, and is free
+ * software which is freely distributable under the terms of the
+ * GNU General Public License version 2, included as the file COPYING in this
+ * distribution.  It is NOT public domain software, and any
+ * redistribution not permitted by the GNU General Public License is
+ * expressly forbidden without prior written permission from
+ * the author.
+ *
+ */
+
+#include <stdbool.h>
+#include <sys/types.h>
+
+struct timespec;
+
+/* A source of events that is watched by the event loop.  When the source
+ * becomes ready its handler is called with the data given when the source was
+ * added.  Handlers are only ever called from event_loop(). */
+struct event_source;
+
+typedef void (*event_handler)(void *data);
+
+/* Call the handler whenever the given file descriptor becomes readable or is
+ * hung up.  Returns NULL and sets errno on error. */
+struct event_source *event_watch_fd(int fd, event_handler handler, void *data);
+
+/* Call the handler whenever the given signal is received.  The signal is
+ * blocked and read from a signalfd instead of being handled asynchronously.
+ * Without signalfds it is unblocked and caught by a handler that only notes
+ * it.  Returns NULL and sets errno on error. */
+struct event_source *event_watch_signal(int signum, event_handler handler,
+    void *data);
+
+/* Call the handler once when the given deadline (see get_deadline()) has
+ * passed.  Returns NULL and sets errno on error. */
+struct event_source *event_add_deadline(const struct timespec *deadline,
+    event_handler handler, void *data);
+
+/* Call the handler once after the given amount of time.  Returns NULL and sets
+ * errno on error. */
+struct event_source *event_add_timer(const struct timespec *timeout,
+    event_handler handler, void *data);
+
+/* Restart the given timer with the given amount of time. */
+bool event_reset_timer(struct event_source *timer,
+    const struct timespec *timeout);
+
+/* Call the handler once when the given child process dies.  The child is not
+ * reaped.  Returns NULL and sets errno on error, which includes kernels
+ * without process file descriptors. */
+struct event_source *event_watch_child(pid_t pid, event_handler handler,
+    void *data);
+
+/* Stop watching the given source and free it.  Descriptors passed to
+ * event_watch_fd() are not closed.  Pending signals of a signal source are
+ * discarded before the signal is unblocked again.  The source may be NULL. */
+void event_remove(struct event_source *source);
+
+/* Dispatch events until the value pointed to by done becomes true.  Returns
+ * false and sets errno on error. */
+bool event_loop(const bool *done);
+
+/* Dispatch events for the given amount of time. */
+bool event_sleep(const struct timespec *timeout);
+
+/* The event loop cannot be shared with a parent process.  A child created
+ * with fork() that wants to use the event loop must call this first.  All
+ * sources of the parent stay registered. */
+bool event_after_fork(void);
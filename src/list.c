@@ -95,6 +95,34 @@ bool list_append(struct list *l, void *data)
   return true;
 }
 
+/* Create a new list item with the given data and insert it after the given
+ * item or at the beginning of the list if the item is NULL. */
+bool list_insert_after(struct list *l, struct list_item *item, void *data)
+{
+  struct list_item *new_item;
+
+  if (item == l->last)
+    return list_append(l, data);
+
+  new_item = malloc(sizeof *new_item);
+
+  if (new_item == NULL)
+    return false;
+
+  new_item->data = data;
+  new_item->previous = item;
+  new_item->next = (item != NULL) ? item->next : l->first;
+
+  new_item->next->previous = new_item;
+
+  if (item != NULL)
+    item->next = new_item;
+  else
+    l->first = new_item;
+
+  return true;
+}
+
 /* Remove the given item from the list.  Returns the item following the deleted
  * one or NULL if the given item was the last. */
 struct list_item *list_delete_item(struct list *l, struct list_item *item)
@@ -44,6 +44,10 @@ size_t list_length(struct list *l);
  * list. */
 bool list_append(struct list *l, void *data);
 
+/* Create a new list item with the given data and insert it after the given
+ * item or at the beginning of the list if the item is NULL. */
+bool list_insert_after(struct list *l, struct list_item *item, void *data);
+
 /* Remove the given item from the list.  Returns the item following the deleted
  * one or NULL if the given item was the last. */
 struct list_item *list_delete_item(struct list *l, struct list_item *item);
@@ -14,6 +14,8 @@
 /* They can define certain functions that are called through vlock's plugin
  * mechanism.  They should also define dependencies if they depend on other
  * plugins of have to be called before or after other plugins. */
+/* Modules export either a single descriptor that contains the hooks and
+ * dependencies or, in the older interface, one symbol for each of them. */
 
 #if !defined(__FreeBSD__) && !defined(_GNU_SOURCE)
 #define _GNU_SOURCE
@@ -32,15 +34,21 @@
 #include "util.h"
 
 #include "plugin.h"
+#include "module_elf.h"
+#include "vlock_plugin.h"
 
 static bool init_module(struct plugin *p);
 static void destroy_module(struct plugin *p);
-static bool call_module_hook(struct plugin *p, const char *hook_name);
+static bool call_module_hook(struct plugin *p, size_t hook);
+static bool check_module(struct plugin *p);
+static bool ensure_module_open(struct plugin *p);
 
 struct plugin_type *module = &(struct plugin_type){
   .init = init_module,
   .destroy = destroy_module,
   .call_hook = call_module_hook,
+  .check = check_module,
+  .open = ensure_module_open,
 };
 
 /* A hook function as defined by a module. */
@@ -48,8 +56,13 @@ typedef bool (*module_hook_function)(void **);
 
 struct module_context
 {
-  /* Handle returned by dlopen(). */
+  /* The path to the module. */
+  char *path;
+  /* Handle returned by dlopen().  NULL until the module is opened. */
   void *dl_handle;
+  /* The descriptor exported by the module or NULL if it uses the old
+   * interface. */
+  const struct vlock_plugin_descriptor *descriptor;
   /* Pointer to be used by the modules. */
   void *module_data;
   /* Array of hook functions befined by a single module.  Stored in the same
@@ -57,6 +70,9 @@ struct module_context
   module_hook_function hooks[nr_hooks];
 };
 
+static bool open_module(struct module_context *context);
+static const char *const *get_dependency(struct module_context *context,
+    size_t index);
 
 /* Initialize a new plugin as a module. */
 bool init_module(struct plugin *p)
@@ -88,31 +104,34 @@ bool init_module(struct plugin *p)
     return false;
   }
 
-  /* Open the module as a shared library. */
-  context->dl_handle = dlopen(path, RTLD_NOW | RTLD_LOCAL);
-
-  free(path);
-
-  if (context->dl_handle == NULL) {
-    errno = 0;
-    free(context);
-    return false;
-  }
+  context->path = path;
+  context->dl_handle = NULL;
+  context->descriptor = NULL;
+  context->module_data = NULL;
 
   /* Initialisation complete.  From now on cleanup is handled by destroy_module(). */
   p->context = context;
 
-  /* Load all the hooks.  Unimplemented hooks are NULL and will not be called later. */
-  for (size_t i = 0; i < nr_hooks; i++)
-    *(void **) (&context->hooks[i]) = dlsym(context->dl_handle, hooks[i].name);
+  /* Read the dependencies without loading the module.  It is then only
+   * loaded when its first hook is called, i.e. if it is not unloaded during
+   * dependency resolution. */
+  if (read_module_dependencies(path, p->dependencies))
+    return true;
+
+  if (errno != 0)
+    return false;
+
+  /* The file could not be understood.  Open it to get the dependencies. */
+  if (!open_module(context))
+    return false;
 
   /* Load all dependencies.  Unspecified dependencies are NULL. */
   for (size_t i = 0; i < nr_dependencies; i++) {
-    const char *(*dependency)[] = dlsym(context->dl_handle, dependency_names[i]);
+    const char *const *dependency = get_dependency(context, i);
 
     /* Append array elements to list. */
-    for (size_t j = 0; dependency != NULL && (*dependency)[j] != NULL; j++) {
-      char *s = strdup((*dependency)[j]);
+    for (size_t j = 0; dependency != NULL && dependency[j] != NULL; j++) {
+      char *s = strdup(dependency[j]);
 
       if (s == NULL)
         return false;
@@ -124,28 +143,113 @@ bool init_module(struct plugin *p)
   return true;
 }
 
+/* Open the module as a shared library and load its hooks.  On error false is
+ * returned and errno is set or, if dlopen() failed, set to 0. */
+static bool open_module(struct module_context *context)
+{
+  context->dl_handle = dlopen(context->path, RTLD_NOW | RTLD_LOCAL);
+
+  if (context->dl_handle == NULL) {
+    errno = 0;
+    return false;
+  }
+
+  context->descriptor = dlsym(context->dl_handle, "vlock_plugin_descriptor");
+
+  if (context->descriptor != NULL) {
+    if (context->descriptor->abi_version != VLOCK_PLUGIN_ABI_VERSION) {
+      dlclose(context->dl_handle);
+      context->dl_handle = NULL;
+      context->descriptor = NULL;
+      errno = ENOEXEC;
+      return false;
+    }
+
+    /* The hooks are stored in the same order. */
+    for (size_t i = 0; i < nr_hooks; i++)
+      context->hooks[i] = context->descriptor->hooks[i];
+  } else {
+    /* Load all the hooks.  Unimplemented hooks are NULL and will not be called later. */
+    for (size_t i = 0; i < nr_hooks; i++)
+      *(void **) (&context->hooks[i]) = dlsym(context->dl_handle, hooks[i].name);
+  }
+
+  return true;
+}
+
+/* Get the dependency array with the given index from an opened module.
+ * Unspecified dependencies are NULL. */
+static const char *const *get_dependency(struct module_context *context,
+    size_t index)
+{
+  const struct vlock_plugin_descriptor *descriptor = context->descriptor;
+
+  if (descriptor == NULL)
+    return dlsym(context->dl_handle, dependency_names[index]);
+
+  /* In the order of dependency_names. */
+  switch (index) {
+    case 0: return descriptor->succeeds;
+    case 1: return descriptor->preceeds;
+    case 2: return descriptor->requires;
+    case 3: return descriptor->needs;
+    case 4: return descriptor->depends;
+    default: return descriptor->conflicts;
+  }
+}
+
+/* Check that the real user may read the module.  See init_module(). */
+static bool check_module(struct plugin *p)
+{
+  struct module_context *context = p->context;
+
+  return access(context->path, R_OK) == 0;
+}
+
 static void destroy_module(struct plugin *p)
 {
   struct module_context *context = p->context;
 
   if (context != NULL) {
-    dlclose(context->dl_handle);
+    if (context->dl_handle != NULL)
+      dlclose(context->dl_handle);
+
+    free(context->path);
     free(context);
   }
 }
 
-static bool call_module_hook(struct plugin *p, const char *hook_name)
+/* Open the module unless this was already done.  Modules are opened when
+ * their first hook is called or, in the lock service, right after resolving
+ * the dependencies.  Prints a message on error. */
+static bool ensure_module_open(struct plugin *p)
 {
   struct module_context *context = p->context;
 
-  /* Find the right hook index. */
-  for (size_t i = 0; i < nr_hooks; i++)
-    if (strcmp(hooks[i].name, hook_name) == 0) {
-      module_hook_function hook = context->hooks[i];
+  if (context->dl_handle != NULL)
+    return true;
 
-      if (hook != NULL)
-        return hook(&context->module_data);
-    }
+  if (open_module(context))
+    return true;
+
+  if (errno != 0)
+    fprintf(stderr, "vlock-module: '%s': unsupported module interface\n",
+        context->path);
+  else
+    fprintf(stderr, "vlock-module: %s\n", dlerror());
+
+  return false;
+}
+
+static bool call_module_hook(struct plugin *p, size_t hook)
+{
+  struct module_context *context = p->context;
+
+  if (!ensure_module_open(p))
+    return false;
+
+  if (context->hooks[hook] != NULL)
+    return context->hooks[hook](&context->module_data);
 
   return true;
 }
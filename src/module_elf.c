@@ -0,0 +1,447 @@
+/* module_elf.c -- reading module dependencies for vlock,
+ *                 the VT locking program for linux
+ *
+ * This program is copyright (C) 2007 Frank Benkstein, and is free
+ * software which is freely distributable under the terms of the
+ * GNU General Public License version 2, included as the file COPYING in this
+ * distribution.  It is NOT public domain software, and any
+ * redistribution not permitted by the GNU General Public License is
+ * expressly forbidden without prior written permission from
+ * the author.
+ *
+ */
+
+/* Modules declare their dependencies as NULL terminated arrays of strings,
+ * e.g.:
+ *
+ *   const char *depends[] = { "all", NULL };
+ *
+ * Loading a module just to look at these arrays runs its constructors and
+ * pulls in all the libraries it is linked against, even if the module is
+ * unloaded again because its dependencies are not met.  Instead the arrays
+ * are looked up in the dynamic symbol table of the file.  The pointers in the
+ * array are resolved through the relative relocations the dynamic linker
+ * would apply, the strings are then read from the loadable segments.
+ *
+ * Modules using the descriptor interface are read the same way, starting at
+ * the descriptor.
+ *
+ * Only files of the same class, byte order and architecture as vlock-main
+ * are understood.  Anything unexpected makes the caller fall back to
+ * dlopen(). */
+
+#if !defined(__FreeBSD__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <elf.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "list.h"
+#include "util.h"
+
+#include "plugin.h"
+#include "module_elf.h"
+#include "vlock_plugin.h"
+
+#if __SIZEOF_POINTER__ == 8
+#define ELF_CLASS ELFCLASS64
+typedef Elf64_Ehdr Elf_Ehdr;
+typedef Elf64_Phdr Elf_Phdr;
+typedef Elf64_Shdr Elf_Shdr;
+typedef Elf64_Sym Elf_Sym;
+typedef Elf64_Rel Elf_Rel;
+typedef Elf64_Rela Elf_Rela;
+typedef Elf64_Addr Elf_Addr;
+#define ELF_ST_TYPE ELF64_ST_TYPE
+#define ELF_R_TYPE ELF64_R_TYPE
+#else
+#define ELF_CLASS ELFCLASS32
+typedef Elf32_Ehdr Elf_Ehdr;
+typedef Elf32_Phdr Elf_Phdr;
+typedef Elf32_Shdr Elf_Shdr;
+typedef Elf32_Sym Elf_Sym;
+typedef Elf32_Rel Elf_Rel;
+typedef Elf32_Rela Elf_Rela;
+typedef Elf32_Addr Elf_Addr;
+#define ELF_ST_TYPE ELF32_ST_TYPE
+#define ELF_R_TYPE ELF32_R_TYPE
+#endif
+
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define ELF_DATA ELFDATA2LSB
+#else
+#define ELF_DATA ELFDATA2MSB
+#endif
+
+#if defined(__x86_64__)
+#define ELF_MACHINE EM_X86_64
+#define RELATIVE_RELOCATION R_X86_64_RELATIVE
+#elif defined(__i386__)
+#define ELF_MACHINE EM_386
+#define RELATIVE_RELOCATION R_386_RELATIVE
+#elif defined(__aarch64__)
+#define ELF_MACHINE EM_AARCH64
+#define RELATIVE_RELOCATION R_AARCH64_RELATIVE
+#elif defined(__arm__)
+#define ELF_MACHINE EM_ARM
+#define RELATIVE_RELOCATION R_ARM_RELATIVE
+#endif
+
+struct elf_image
+{
+  const char *data;
+  size_t size;
+  Elf_Ehdr header;
+  /* Offsets of the program and section header tables. */
+  size_t program_headers;
+  size_t section_headers;
+};
+
+/* Copy length bytes at the given file offset.  Fails if they are not inside
+ * the file.  Everything is copied because nothing in the file is guaranteed to
+ * be aligned. */
+static bool copy_from(const struct elf_image *image, size_t offset, void *p,
+    size_t length)
+{
+  if (offset > image->size || length > image->size - offset)
+    return false;
+
+  memcpy(p, image->data + offset, length);
+  return true;
+}
+
+static bool get_section(const struct elf_image *image, size_t index,
+    Elf_Shdr *section)
+{
+  return index < image->header.e_shnum
+    && copy_from(image, image->section_headers + index * sizeof *section,
+        section, sizeof *section);
+}
+
+/* Translate a virtual address to a file offset.  The range of length bytes
+ * must be inside a single loadable segment. */
+static bool get_offset(const struct elf_image *image, Elf_Addr address,
+    size_t length, size_t *offset)
+{
+  for (size_t i = 0; i < image->header.e_phnum; i++) {
+    Elf_Phdr segment;
+
+    if (!copy_from(image, image->program_headers + i * sizeof segment,
+          &segment, sizeof segment))
+      return false;
+
+    if (segment.p_type == PT_LOAD
+        && address >= segment.p_vaddr
+        && address - segment.p_vaddr < segment.p_filesz
+        && length <= segment.p_filesz - (address - segment.p_vaddr)) {
+      *offset = segment.p_offset + (address - segment.p_vaddr);
+      return true;
+    }
+  }
+
+  return false;
+}
+
+/* Find the named symbol in the dynamic symbol table. */
+static bool find_symbol(const struct elf_image *image, const Elf_Shdr *symbols,
+    const char *name, Elf_Sym *symbol)
+{
+  size_t name_length = strlen(name);
+  Elf_Shdr strings;
+
+  if (symbols->sh_entsize != sizeof *symbol
+      || !get_section(image, symbols->sh_link, &strings))
+    return false;
+
+  for (size_t i = 0; i < symbols->sh_size / sizeof *symbol; i++) {
+    if (!copy_from(image, symbols->sh_offset + i * sizeof *symbol, symbol,
+          sizeof *symbol))
+      return false;
+
+    if (symbol->st_name < strings.sh_size
+        && name_length < strings.sh_size - symbol->st_name
+        && symbol->st_shndx != SHN_UNDEF
+        && strings.sh_offset + symbol->st_name + name_length < image->size
+        && memcmp(image->data + strings.sh_offset + symbol->st_name, name,
+          name_length + 1) == 0)
+      return true;
+  }
+
+  return false;
+}
+
+#ifdef RELATIVE_RELOCATION
+/* Get the value of the pointer at the given address as it would be after
+ * relocation relative to a load address of 0. */
+static bool read_pointer(const struct elf_image *image, Elf_Addr address,
+    Elf_Addr *value)
+{
+  size_t offset;
+
+  if (!get_offset(image, address, sizeof *value, &offset)
+      || !copy_from(image, offset, value, sizeof *value))
+    return false;
+
+  for (size_t i = 0; i < image->header.e_shnum; i++) {
+    Elf_Shdr section;
+
+    if (!get_section(image, i, &section))
+      return false;
+
+    if (section.sh_type == SHT_RELA && section.sh_entsize == sizeof (Elf_Rela)) {
+      for (size_t j = 0; j < section.sh_size / sizeof (Elf_Rela); j++) {
+        Elf_Rela relocation;
+
+        if (!copy_from(image, section.sh_offset + j * sizeof relocation,
+              &relocation, sizeof relocation))
+          return false;
+
+        if (relocation.r_offset == address) {
+          *value = relocation.r_addend;
+          return ELF_R_TYPE(relocation.r_info) == RELATIVE_RELOCATION;
+        }
+      }
+    } else if (section.sh_type == SHT_REL && section.sh_entsize == sizeof (Elf_Rel)) {
+      for (size_t j = 0; j < section.sh_size / sizeof (Elf_Rel); j++) {
+        Elf_Rel relocation;
+
+        if (!copy_from(image, section.sh_offset + j * sizeof relocation,
+              &relocation, sizeof relocation))
+          return false;
+
+        /* The addend is stored in place. */
+        if (relocation.r_offset == address)
+          return ELF_R_TYPE(relocation.r_info) == RELATIVE_RELOCATION;
+      }
+    }
+  }
+
+  /* Not relocated or packed relative relocations which also store the addend
+   * in place. */
+  return true;
+}
+
+/* Get the string at the given address. */
+static const char *read_string(const struct elf_image *image, Elf_Addr address)
+{
+  size_t offset;
+
+  if (!get_offset(image, address, 1, &offset))
+    return NULL;
+
+  if (memchr(image->data + offset, '\0', image->size - offset) == NULL)
+    return NULL;
+
+  return image->data + offset;
+}
+
+/* Append the strings of the NULL terminated array of at most nr_elements
+ * pointers at the given address to the list.  Returns false with errno set to
+ * 0 if the array cannot be read. */
+static bool read_array(const struct elf_image *image, Elf_Addr address,
+    size_t nr_elements, struct list *dependency_list)
+{
+  for (size_t i = 0; i < nr_elements; i++) {
+    Elf_Addr value;
+    const char *string;
+    char *s;
+
+    if (!read_pointer(image, address + i * sizeof value, &value)) {
+      errno = 0;
+      return false;
+    }
+
+    if (value == 0)
+      return true;
+
+    string = read_string(image, value);
+
+    if (string == NULL) {
+      errno = 0;
+      return false;
+    }
+
+    s = strdup(string);
+
+    if (s == NULL || !list_append(dependency_list, s)) {
+      free(s);
+      errno = ENOMEM;
+      return false;
+    }
+  }
+
+  /* The array is not terminated. */
+  errno = 0;
+  return false;
+}
+
+/* Offsets of the dependency arrays in the descriptor in the order of
+ * dependency_names. */
+static const size_t descriptor_dependencies[nr_dependencies] = {
+  offsetof(struct vlock_plugin_descriptor, succeeds),
+  offsetof(struct vlock_plugin_descriptor, preceeds),
+  offsetof(struct vlock_plugin_descriptor, requires),
+  offsetof(struct vlock_plugin_descriptor, needs),
+  offsetof(struct vlock_plugin_descriptor, depends),
+  offsetof(struct vlock_plugin_descriptor, conflicts),
+};
+
+/* Read the dependencies from the descriptor described by the symbol. */
+static bool read_descriptor(const struct elf_image *image,
+    const Elf_Sym *symbol, struct list **dependencies)
+{
+  unsigned int abi_version;
+  size_t offset;
+
+  if (ELF_ST_TYPE(symbol->st_info) != STT_OBJECT
+      || symbol->st_size < sizeof (struct vlock_plugin_descriptor)
+      || !get_offset(image, symbol->st_value, sizeof abi_version, &offset)
+      || !copy_from(image, offset, &abi_version, sizeof abi_version)
+      || abi_version != VLOCK_PLUGIN_ABI_VERSION) {
+    errno = 0;
+    return false;
+  }
+
+  for (size_t i = 0; i < nr_dependencies; i++) {
+    Elf_Addr array;
+
+    if (!read_pointer(image, symbol->st_value + descriptor_dependencies[i],
+          &array)) {
+      errno = 0;
+      return false;
+    }
+
+    /* The length of the array is unknown, it must end inside its segment. */
+    if (array != 0 && !read_array(image, array, SIZE_MAX, dependencies[i]))
+      return false;
+  }
+
+  return true;
+}
+
+static bool read_image(struct elf_image *image, struct list **dependencies)
+{
+  Elf_Shdr symbols;
+  Elf_Sym symbol;
+  bool have_symbols = false;
+
+  if (!copy_from(image, 0, &image->header, sizeof image->header)
+      || memcmp(image->header.e_ident, ELFMAG, SELFMAG) != 0
+      || image->header.e_ident[EI_CLASS] != ELF_CLASS
+      || image->header.e_ident[EI_DATA] != ELF_DATA
+      || image->header.e_type != ET_DYN
+      || image->header.e_machine != ELF_MACHINE
+      || image->header.e_phentsize != sizeof (Elf_Phdr)
+      || image->header.e_shentsize != sizeof (Elf_Shdr)) {
+    errno = 0;
+    return false;
+  }
+
+  image->program_headers = image->header.e_phoff;
+  image->section_headers = image->header.e_shoff;
+
+  for (size_t i = 0; i < image->header.e_shnum && !have_symbols; i++) {
+    if (!get_section(image, i, &symbols)) {
+      errno = 0;
+      return false;
+    }
+
+    have_symbols = (symbols.sh_type == SHT_DYNSYM);
+  }
+
+  if (!have_symbols) {
+    errno = 0;
+    return false;
+  }
+
+  if (find_symbol(image, &symbols, "vlock_plugin_descriptor", &symbol))
+    return read_descriptor(image, &symbol, dependencies);
+
+  for (size_t i = 0; i < nr_dependencies; i++) {
+    /* Unspecified dependencies stay empty. */
+    if (!find_symbol(image, &symbols, dependency_names[i], &symbol))
+      continue;
+
+    if (ELF_ST_TYPE(symbol.st_info) != STT_OBJECT) {
+      errno = 0;
+      return false;
+    }
+
+    if (!read_array(image, symbol.st_value, symbol.st_size / sizeof (Elf_Addr),
+          dependencies[i]))
+      return false;
+  }
+
+  return true;
+}
+#else
+static bool read_image(struct elf_image *image, struct list **dependencies)
+{
+  (void) image;
+  (void) dependencies;
+
+  /* Unknown architecture. */
+  errno = 0;
+  return false;
+}
+#endif
+
+bool read_module_dependencies(const char *path, struct list **dependencies)
+{
+  struct elf_image image;
+  struct stat st;
+  void *data;
+  bool result;
+  int errsv;
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+
+  if (fd < 0)
+    return false;
+
+  if (fstat(fd, &st) < 0) {
+    GUARD_ERRNO((void) close(fd));
+    return false;
+  }
+
+  if (!S_ISREG(st.st_mode) || st.st_size == 0) {
+    (void) close(fd);
+    errno = 0;
+    return false;
+  }
+
+  data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  errsv = errno;
+  (void) close(fd);
+
+  if (data == MAP_FAILED) {
+    errno = errsv;
+    return false;
+  }
+
+  image.data = data;
+  image.size = st.st_size;
+
+  result = read_image(&image, dependencies);
+  errsv = errno;
+
+  (void) munmap(data, st.st_size);
+
+  if (!result)
+    for (size_t i = 0; i < nr_dependencies; i++)
+      list_delete_for_each(dependencies[i], dependency_item)
+        free(dependency_item->data);
+
+  errno = errsv;
+  return result;
+}
@@ -0,0 +1,23 @@
+/* module_elf.h -- header file for reading module dependencies for vlock,
+ *                 the VT locking program for linux
+ *
+ * This program is copyright (C) 2007 Frank Benkstein, and is free
+ * software which is freely distributable under the terms of the
+ * GNU General Public License version 2, included as the file COPYING in this
+ * distribution.  It is NOT public domain software, and any
+ * redistribution not permitted by the GNU General Public License is
+ * expressly forbidden without prior written permission from
+ * the author.
+ *
+ */
+
+#include <stdbool.h>
+
+struct list;
+
+/* Read the dependency arrays of the module at the given path directly from
+ * the ELF file without loading it.  The dependencies are appended to the
+ * given array of nr_dependencies lists.  If the file cannot be understood
+ * false is returned, errno is set to 0 and the lists are left empty.  On
+ * other errors false is returned and errno is set. */
+bool read_module_dependencies(const char *path, struct list **dependencies);
@@ -18,6 +18,7 @@
 #include "list.h"
 
 #include "plugin.h"
+#include "trace.h"
 #include "util.h"
 
 /* Allocate a new plugin struct. */
@@ -44,6 +45,7 @@ struct plugin *new_plugin(const char *name, struct plugin_type *type)
 
   p->context = NULL;
   p->save_disabled = false;
+  memset(p->stats, 0, sizeof p->stats);
 
   for (size_t i = 0; i < nr_dependencies; i++)
     p->dependencies[i] = list_new();
@@ -76,7 +78,44 @@ void destroy_plugin(struct plugin *p)
   free(p);
 }
 
-bool call_hook(struct plugin *p, const char *hook_name)
+bool open_plugin(struct plugin *p)
 {
-  return p->type->call_hook(p, hook_name);
+  if (p->type->open == NULL)
+    return true;
+
+  return p->type->open(p);
+}
+
+bool call_hook(struct plugin *p, size_t hook)
+{
+  bool result;
+
+  trace_begin(hooks[hook].name, p->name);
+  result = p->type->call_hook(p, hook);
+  trace_end();
+
+  return result;
+}
+
+struct plugin *finish_plugins(struct list *plugins)
+{
+  struct plugin_type *types[] = { builtin, module, script };
+
+  for (size_t i = 0; i < sizeof types / sizeof types[0]; i++)
+    if (types[i]->finish != NULL) {
+      struct plugin *p = types[i]->finish(plugins);
+
+      if (p != NULL)
+        return p;
+    }
+
+  return NULL;
+}
+
+bool check_plugin(struct plugin *p)
+{
+  if (p->type->check == NULL)
+    return true;
+
+  return p->type->check(p);
 }
@@ -12,22 +12,45 @@
  */
 
 #include <stdbool.h>
+#include <stddef.h>
 
 /* Names of dependencies plugins may specify. */
 #define nr_dependencies 6
 extern const char *dependency_names[nr_dependencies];
 
-/* A plugin hook consists of a name and a handler function. */
+/* A plugin hook consists of a name and a handler function.  The handler is
+ * given the index of the hook. */
 struct hook
 {
   const char *name;
-  void (*handler)(const char *);
+  void (*handler)(size_t);
 };
 
 /* Hooks that a plugin may define. */
 #define nr_hooks 4
 extern const struct hook hooks[nr_hooks];
 
+/* Indices of the hooks above.  These match the hook indices of the module
+ * interface. */
+#define HOOK_VLOCK_START 0
+#define HOOK_VLOCK_END 1
+#define HOOK_VLOCK_SAVE 2
+#define HOOK_VLOCK_SAVE_ABORT 3
+
+/* Upper bounds in nanoseconds of the buckets of the hook time histograms.
+ * The last bucket has no bound. */
+#define nr_hook_buckets 6
+extern const long long hook_bucket_bounds[nr_hook_buckets - 1];
+
+/* The wall clock time spent in one hook of a plugin. */
+struct hook_stats
+{
+  unsigned int calls;
+  unsigned int buckets[nr_hook_buckets];
+  long long total_nsec;
+  long long max_nsec;
+};
+
 struct plugin_type;
 
 /* Struct representing a plugin instance. */
@@ -45,6 +68,9 @@ struct plugin
   /* Did one of the save hooks fail? */
   bool save_disabled;
 
+  /* Time spent in each hook. */
+  struct hook_stats stats[nr_hooks];
+
   /* The type of the plugin. */
   struct plugin_type *type;
 
@@ -60,10 +86,27 @@ struct plugin_type
   bool (*init)(struct plugin *p);
   /* Method that is called on plugin destruction.  */
   void (*destroy)(struct plugin *p);
-  /* Method that is called when a hook should be executed.  */
-  bool (*call_hook)(struct plugin *p, const char *name);
+  /* Method that is called when a hook should be executed.  The hook is
+   * given by its index in the hooks array. */
+  bool (*call_hook)(struct plugin *p, size_t hook);
+  /* Method that checks whether the real user may use the plugin.  May be
+   * NULL if no check is needed. */
+  bool (*check)(struct plugin *p);
+  /* Method that completes the initialization of all plugins of this type in
+   * the given list whose init method left work to be done.  This allows
+   * loading many plugins concurrently.  Returns the first plugin that failed
+   * with errno set or NULL on success.  May be NULL if init does all the
+   * work. */
+  struct plugin *(*finish)(struct list *plugins);
+  /* Method that does the work that would otherwise be done when the first
+   * hook is called.  The lock service calls it for the plugins that are left
+   * after resolving the dependencies so that its clients do not repeat the
+   * work.  May be NULL. */
+  bool (*open)(struct plugin *p);
 };
 
+/* Modules linked into vlock-main. */
+extern struct plugin_type *builtin;
 /* Modules. */
 extern struct plugin_type *module;
 /* Scripts. */
@@ -77,5 +120,17 @@ struct plugin *new_plugin(const char *name, struct plugin_type *type);
  * This function should not be called directly. */
 void destroy_plugin(struct plugin *p);
 
-/* Call the hook of a plugin. */
-bool call_hook(struct plugin *p, const char *hook_name);
+/* Complete the initialization of all plugins in the given list.  This must be
+ * called before the dependencies of a newly loaded plugin are used.  Returns
+ * the first plugin that failed with errno set or NULL on success. */
+struct plugin *finish_plugins(struct list *plugins);
+
+/* Check whether the real user may use the plugin.  Fails with errno set if
+ * not. */
+bool check_plugin(struct plugin *p);
+
+/* Prepare the plugin for calling its hooks, see struct plugin_type. */
+bool open_plugin(struct plugin *p);
+
+/* Call the hook with the given index of a plugin. */
+bool call_hook(struct plugin *p, size_t hook);
@@ -14,6 +14,9 @@
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <time.h>
+#include <signal.h>
+#include <pthread.h>
 
 #include "plugins.h"
 
@@ -21,6 +24,8 @@
 #include "tsort.h"
 
 #include "plugin.h"
+#include "builtin.h"
+#include "trace.h"
 #include "util.h"
 
 /* the list of plugins */
@@ -50,10 +55,10 @@ const char *dependency_names[nr_dependencies] = {
 /* hooks */
 /*********/
 
-static void handle_vlock_start(const char * hook_name);
-static void handle_vlock_end(const char * hook_name);
-static void handle_vlock_save(const char * hook_name);
-static void handle_vlock_save_abort(const char * hook_name);
+static void handle_vlock_start(size_t hook);
+static void handle_vlock_end(size_t hook);
+static void handle_vlock_save(size_t hook);
+static void handle_vlock_save_abort(size_t hook);
 
 const struct hook hooks[nr_hooks] = {
   { "vlock_start", handle_vlock_start },
@@ -73,18 +78,65 @@ static bool sort_plugins(void);
 
 bool load_plugin(const char *name)
 {
-  return __load_plugin(name) != NULL;
+  bool result;
+
+  trace_begin("load_plugin", name);
+  result = (__load_plugin(name) != NULL);
+  trace_end();
+
+  return result;
 }
 
 bool resolve_dependencies(void)
 {
-  return __resolve_depedencies() && sort_plugins();
+  bool result;
+
+  trace_begin("resolve_dependencies", NULL);
+  result = __resolve_depedencies() && sort_plugins();
+  trace_end();
+
+  return result;
+}
+
+bool check_plugins(void)
+{
+  list_for_each(plugins, plugin_item) {
+    struct plugin *p = plugin_item->data;
+
+    if (!check_plugin(p)) {
+      fprintf(stderr, "vlock-plugins: '%s' may not be used: %s\n", p->name, STRERROR);
+      return false;
+    }
+  }
+
+  return true;
+}
+
+bool open_plugins(void)
+{
+  bool result = true;
+
+  trace_begin("open_plugins", NULL);
+
+  list_for_each(plugins, plugin_item)
+    if (!open_plugin(plugin_item->data)) {
+      result = false;
+      break;
+    }
+
+  trace_end();
+
+  return result;
 }
 
 void unload_plugins(void)
 {
+  trace_begin("unload_plugins", NULL);
+
   list_delete_for_each(plugins, plugin_item)
     destroy_plugin(plugin_item->data);
+
+  trace_end();
 }
 
 void plugin_hook(const char *hook_name)
@@ -92,7 +144,9 @@ void plugin_hook(const char *hook_name)
   for (size_t i = 0; i < nr_hooks; i++)
     /* Get the handler and call it. */
     if (strcmp(hook_name, hooks[i].name) == 0) {
-      hooks[i].handler(hook_name);
+      trace_begin("plugin_hook", hook_name);
+      hooks[i].handler(i);
+      trace_end();
       break;
     }
 }
@@ -120,7 +174,16 @@ static struct plugin *__load_plugin(const char *name)
   if (p != NULL)
     return p;
 
-  /* Try to open a module first. */
+  /* Try builtin modules first. */
+  p = new_plugin(name, builtin);
+
+  if (p != NULL)
+    goto success;
+
+  if (errno != ENOENT)
+    return NULL;
+
+  /* Now try to open a module. */
   p = new_plugin(name, module);
 
   if (p != NULL)
@@ -144,6 +207,33 @@ success:
   return p;
 }
 
+/* Complete loading all plugins that were started by __load_plugin().  Prints a
+ * message on error. */
+static bool finish_loading(void)
+{
+  struct plugin *p = finish_plugins(plugins);
+
+  if (p != NULL) {
+    fprintf(stderr, "vlock-plugins: loading '%s' failed: %s\n", p->name, STRERROR);
+    return false;
+  }
+
+  return true;
+}
+
+/* Are all plugins builtin modules? */
+static bool only_builtins(void)
+{
+  list_for_each(plugins, plugin_item) {
+    struct plugin *p = plugin_item->data;
+
+    if (p->type != builtin)
+      return false;
+  }
+
+  return true;
+}
+
 /* Resolve the dependencies of the plugins. */
 static bool __resolve_depedencies(void)
 {
@@ -155,6 +245,15 @@ static bool __resolve_depedencies(void)
   list_for_each(plugins, plugin_item) {
     struct plugin *p = plugin_item->data;
 
+    /* Plugins are only started by __load_plugin().  Complete loading all of
+     * them, i.e. the initially requested ones and those required in previous
+     * iterations, in one go. */
+    if (!finish_loading()) {
+      list_free(required_plugins);
+      errno = 0;
+      return false;
+    }
+
     list_for_each(p->dependencies[REQUIRES], dependency_item) {
       const char *d = dependency_item->data;
       struct plugin *q = __load_plugin(d);
@@ -234,7 +333,21 @@ static bool __resolve_depedencies(void)
 
   list_free(required_plugins);
 
-  /* Fail if conflicting plugins are loaded. */
+  /* Fail if conflicting plugins are loaded.  Conflicts between builtin
+   * modules are known in advance. */
+  if (only_builtins()) {
+    struct plugin *p;
+    struct plugin *q;
+
+    if (find_builtin_conflict(plugins, &p, &q)) {
+      fprintf(stderr, "vlock-plugins: '%s' and '%s' cannot be loaded at the same time\n", p->name, q->name);
+      errno = 0;
+      return false;
+    }
+
+    return true;
+  }
+
   list_for_each(plugins, plugin_item) {
     struct plugin *p = plugin_item->data;
 
@@ -251,14 +364,42 @@ static bool __resolve_depedencies(void)
   return true;
 }
 
+static struct list *merge_plugins(void);
 static struct list *get_edges(void);
 
+/* Switch the global list of plugins for the sorted list.  The global list is
+ * static and cannot be freed. */
+static void replace_plugins(struct list *sorted_plugins)
+{
+  struct list_item *first = sorted_plugins->first;
+  struct list_item *last = sorted_plugins->last;
+
+  sorted_plugins->first = plugins->first;
+  sorted_plugins->last = plugins->last;
+
+  plugins->first = first;
+  plugins->last = last;
+
+  list_free(sorted_plugins);
+}
+
 /* Sort the list of plugins according to their "preceeds" and "succeeds"
  * dependencies.  Fails if sorting is not possible because of circles. */
 static bool sort_plugins(void)
 {
-  struct list *edges = get_edges();
-  struct list *sorted_plugins;
+  struct list *edges;
+  struct list *sorted_plugins = merge_plugins();
+
+  if (sorted_plugins != NULL) {
+    replace_plugins(sorted_plugins);
+    return true;
+  }
+
+  if (errno != 0)
+    return false;
+
+  /* The quick way did not work.  Sort all plugins. */
+  edges = get_edges();
 
   if (edges == NULL)
     return false;
@@ -279,19 +420,7 @@ static bool sort_plugins(void)
   }
 
   if (sorted_plugins != NULL) {
-    /* Switch the global list of plugins for the sorted list.  The global list
-     * is static and cannot be freed. */
-    struct list_item *first = sorted_plugins->first;
-    struct list_item *last = sorted_plugins->last;
-
-    sorted_plugins->first = plugins->first;
-    sorted_plugins->last = plugins->last;
-
-    plugins->first = first;
-    plugins->last = last;
-
-    list_free(sorted_plugins);
-
+    replace_plugins(sorted_plugins);
     return true;
   } else {
     fprintf(stderr, "vlock-plugins: circular dependencies detected\n");
@@ -299,6 +428,82 @@ static bool sort_plugins(void)
   }
 }
 
+/* Must plugin p come before plugin q? */
+static bool must_precede(struct plugin *p, struct plugin *q)
+{
+  list_for_each(p->dependencies[PRECEEDS], successor_item)
+    if (strcmp(successor_item->data, q->name) == 0)
+      return true;
+
+  list_for_each(q->dependencies[SUCCEEDS], predecessor_item)
+    if (strcmp(predecessor_item->data, p->name) == 0)
+      return true;
+
+  return false;
+}
+
+/* Sort the plugins without building the whole graph.  The builtin modules are
+ * sorted by their precomputed positions.  Every other plugin is then
+ * inserted right after the last plugin it must follow.  Returns NULL with
+ * errno set to 0 if a plugin cannot be placed this way. */
+static struct list *merge_plugins(void)
+{
+  struct list *sorted_plugins = list_new();
+
+  if (sorted_plugins == NULL)
+    return NULL;
+
+  list_for_each(plugins, plugin_item) {
+    struct plugin *p = plugin_item->data;
+    struct list_item *position = NULL;
+
+    if (p->type != builtin)
+      continue;
+
+    list_for_each(sorted_plugins, sorted_item)
+      if (get_builtin_rank(sorted_item->data) <= get_builtin_rank(p))
+        position = sorted_item;
+
+    if (!list_insert_after(sorted_plugins, position, p))
+      goto error;
+  }
+
+  list_for_each(plugins, plugin_item) {
+    struct plugin *p = plugin_item->data;
+    struct list_item *position = NULL;
+
+    if (p->type == builtin)
+      continue;
+
+    list_for_each(sorted_plugins, sorted_item)
+      if (must_precede(sorted_item->data, p))
+        position = sorted_item;
+
+    /* Nothing up to the position may have to come after p. */
+    list_for_each_from_increment(sorted_plugins, sorted_item,
+        position != NULL ? sorted_plugins->first : NULL,
+        sorted_item = sorted_item->next) {
+      if (must_precede(p, sorted_item->data)) {
+        list_free(sorted_plugins);
+        errno = 0;
+        return NULL;
+      }
+
+      if (sorted_item == position)
+        break;
+    }
+
+    if (!list_insert_after(sorted_plugins, position, p))
+      goto error;
+  }
+
+  return sorted_plugins;
+
+error:
+  GUARD_ERRNO(list_free(sorted_plugins));
+  return NULL;
+}
+
 static bool append_edge(struct list *edges, struct plugin *p, struct plugin *s)
 {
   struct edge *e = malloc(sizeof *e);
@@ -354,6 +559,232 @@ error:
   return NULL;
 }
 
+/*****************/
+/* hook watchdog */
+/*****************/
+
+/* Hooks must not block.  The time spent in every hook is recorded and
+ * summarized at the end if debugging is enabled.  If VLOCK_HOOK_BUDGET is set
+ * a watchdog thread warns about a hook that takes longer while it is still
+ * running.  Hooks of modules run inside vlock and cannot be stopped, so with
+ * VLOCK_HOOK_POLICY=skip a plugin that exceeded the budget only has its save
+ * hooks disabled afterwards, just like when they fail.  The vlock_end hook is
+ * always called.  For scripts the time until the hook name was written to the
+ * script is measured. */
+
+/* Set by vlock-main. */
+extern int vlock_debug;
+
+const long long hook_bucket_bounds[nr_hook_buckets - 1] = {
+  100000LL, 1000000LL, 10000000LL, 100000000LL, 1000000000LL,
+};
+
+static struct
+{
+  bool initialized;
+  bool enabled;
+  bool skip;
+  struct timespec budget;
+  bool started;
+  pthread_mutex_t lock;
+  pthread_cond_t changed;
+  /* The hook that is running, if armed. */
+  bool armed;
+  unsigned long generation;
+  const char *plugin;
+  const char *hook;
+  struct timespec deadline;
+} watchdog = {
+  .lock = PTHREAD_MUTEX_INITIALIZER,
+};
+
+static void *run_watchdog(void *argument)
+{
+  (void) argument;
+
+  (void) pthread_mutex_lock(&watchdog.lock);
+
+  for (;;) {
+    unsigned long generation;
+
+    while (!watchdog.armed)
+      (void) pthread_cond_wait(&watchdog.changed, &watchdog.lock);
+
+    generation = watchdog.generation;
+
+    if (pthread_cond_timedwait(&watchdog.changed, &watchdog.lock,
+          &watchdog.deadline) == ETIMEDOUT
+        && watchdog.armed && watchdog.generation == generation) {
+      fprintf(stderr, "vlock: plugin '%s' blocks in %s for more than "
+          "%ld.%03ld seconds\n", watchdog.plugin, watchdog.hook,
+          (long) watchdog.budget.tv_sec, watchdog.budget.tv_nsec / 1000000L);
+      /* Warn only once per call. */
+      watchdog.armed = false;
+    }
+  }
+
+  return NULL;
+}
+
+static bool start_watchdog(void)
+{
+  pthread_condattr_t attr;
+  pthread_t thread;
+  sigset_t all_signals;
+  sigset_t old_signals;
+  int error;
+
+  /* Deadlines are measured against CLOCK_MONOTONIC. */
+  if (pthread_condattr_init(&attr) != 0)
+    return false;
+
+  (void) pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  error = pthread_cond_init(&watchdog.changed, &attr);
+  (void) pthread_condattr_destroy(&attr);
+
+  if (error != 0)
+    return false;
+
+  /* Signals are only for the main thread. */
+  (void) sigfillset(&all_signals);
+  (void) pthread_sigmask(SIG_BLOCK, &all_signals, &old_signals);
+
+  error = pthread_create(&thread, NULL, run_watchdog, NULL);
+
+  if (error == 0)
+    (void) pthread_detach(thread);
+
+  (void) pthread_sigmask(SIG_SETMASK, &old_signals, NULL);
+
+  return error == 0;
+}
+
+static void init_watchdog(void)
+{
+  const char *policy = getenv("VLOCK_HOOK_POLICY");
+
+  watchdog.initialized = true;
+  watchdog.enabled = parse_seconds(getenv("VLOCK_HOOK_BUDGET"),
+      &watchdog.budget);
+  watchdog.skip = (policy != NULL && strcmp(policy, "skip") == 0);
+
+  if (watchdog.enabled) {
+    watchdog.started = start_watchdog();
+
+    if (!watchdog.started)
+      perror("vlock: could not start the hook watchdog");
+  }
+}
+
+static void arm_watchdog(struct plugin *p, size_t hook)
+{
+  if (!watchdog.started)
+    return;
+
+  (void) pthread_mutex_lock(&watchdog.lock);
+
+  get_deadline(&watchdog.budget, &watchdog.deadline);
+  watchdog.plugin = p->name;
+  watchdog.hook = hooks[hook].name;
+  watchdog.generation++;
+  watchdog.armed = true;
+  (void) pthread_cond_signal(&watchdog.changed);
+
+  (void) pthread_mutex_unlock(&watchdog.lock);
+}
+
+static void disarm_watchdog(void)
+{
+  if (!watchdog.started)
+    return;
+
+  (void) pthread_mutex_lock(&watchdog.lock);
+  watchdog.armed = false;
+  (void) pthread_cond_signal(&watchdog.changed);
+  (void) pthread_mutex_unlock(&watchdog.lock);
+}
+
+static void record_hook_time(struct hook_stats *stats, long long nsec)
+{
+  size_t bucket = 0;
+
+  while (bucket < nr_hook_buckets - 1 && nsec >= hook_bucket_bounds[bucket])
+    bucket++;
+
+  stats->calls++;
+  stats->buckets[bucket]++;
+  stats->total_nsec += nsec;
+
+  if (nsec > stats->max_nsec)
+    stats->max_nsec = nsec;
+}
+
+/* Call the hook of the plugin while the watchdog watches it. */
+static bool watch_hook(struct plugin *p, size_t hook)
+{
+  struct timespec start;
+  struct timespec end;
+  long long nsec;
+  bool result;
+
+  if (!watchdog.initialized)
+    init_watchdog();
+
+  (void) clock_gettime(CLOCK_MONOTONIC, &start);
+  arm_watchdog(p, hook);
+
+  result = call_hook(p, hook);
+
+  disarm_watchdog();
+  (void) clock_gettime(CLOCK_MONOTONIC, &end);
+
+  nsec = (end.tv_sec - start.tv_sec) * 1000000000LL
+    + (end.tv_nsec - start.tv_nsec);
+  record_hook_time(&p->stats[hook], nsec);
+
+  if (watchdog.enabled && watchdog.skip && hook != HOOK_VLOCK_END
+      && !p->save_disabled
+      && nsec > watchdog.budget.tv_sec * 1000000000LL + watchdog.budget.tv_nsec) {
+    fprintf(stderr, "vlock: plugin '%s' took too long in %s, "
+        "skipping its save hooks\n", p->name, hooks[hook].name);
+
+    /* A slow save hook is handled like a failed one. */
+    if (hook == HOOK_VLOCK_START)
+      p->save_disabled = true;
+    else
+      result = false;
+  }
+
+  return result;
+}
+
+/* Print the time spent in the hooks of each plugin. */
+static void print_hook_profile(void)
+{
+  fprintf(stderr, "vlock: hook profile (calls, total ms, max ms, "
+      "calls <0.1 <1 <10 <100 <1000 >=1000 ms)\n");
+
+  list_for_each(plugins, plugin_item) {
+    struct plugin *p = plugin_item->data;
+
+    for (size_t hook = 0; hook < nr_hooks; hook++) {
+      struct hook_stats *stats = &p->stats[hook];
+
+      if (stats->calls == 0)
+        continue;
+
+      fprintf(stderr, "vlock:   %s %s %u %.3f %.3f",
+          p->name, hooks[hook].name, stats->calls,
+          stats->total_nsec / 1e6, stats->max_nsec / 1e6);
+
+      for (size_t i = 0; i < nr_hook_buckets; i++)
+        fprintf(stderr, " %u", stats->buckets[i]);
+
+      fputc('\n', stderr);
+    }
+  }
+}
+
 /************/
 /* handlers */
 /************/
@@ -361,17 +792,17 @@ error:
 /* Call the "vlock_start" hook of each plugin.  Fails if the hook of one of the
  * plugins fails.  In this case the "vlock_end" hooks of all plugins that were
  * called before are called in reverse order. */
-void handle_vlock_start(const char *hook_name)
+void handle_vlock_start(size_t hook)
 {
   list_for_each(plugins, plugin_item) {
     struct plugin *p = plugin_item->data;
 
-    if (!call_hook(p, hook_name)) {
+    if (!watch_hook(p, hook)) {
       int errsv = errno;
 
       list_for_each_reverse_from(plugins, reverse_item, plugin_item->previous) {
         struct plugin *r = reverse_item->data;
-        (void) call_hook(r, "vlock_end");
+        (void) watch_hook(r, HOOK_VLOCK_END);
       }
 
       if (errsv)
@@ -383,18 +814,21 @@ void handle_vlock_start(const char *hook_name)
 }
 
 /* Call the "vlock_end" hook of each plugin in reverse order.  Never fails. */
-void handle_vlock_end(const char *hook_name)
+void handle_vlock_end(size_t hook)
 {
   list_for_each_reverse(plugins, plugin_item) {
     struct plugin *p = plugin_item->data;
-    (void) call_hook(p, hook_name);
+    (void) watch_hook(p, hook);
   }
+
+  if (vlock_debug)
+    print_hook_profile();
 }
 
 /* Call the "vlock_save" hook of each plugin.  Never fails.  If the hook of a
  * plugin fails its "vlock_save_abort" hook is called and both hooks are never
  * called again afterwards. */
-void handle_vlock_save(const char *hook_name)
+void handle_vlock_save(size_t hook)
 {
   list_for_each(plugins, plugin_item) {
     struct plugin *p = plugin_item->data;
@@ -402,9 +836,9 @@ void handle_vlock_save(const char *hook_name)
     if (p->save_disabled)
       continue;
 
-    if (!call_hook(p, hook_name)) {
+    if (!watch_hook(p, hook)) {
       p->save_disabled = true;
-      (void) call_hook(p, "vlock_save_abort");
+      (void) watch_hook(p, HOOK_VLOCK_SAVE_ABORT);
     }
   }
 }
@@ -412,7 +846,7 @@ void handle_vlock_save(const char *hook_name)
 /* Call the "vlock_save" hook of each plugin.  Never fails.  If the hook of a
  * plugin fails both hooks "vlock_save" and "vlock_save_abort" are never called
  * again afterwards. */
-void handle_vlock_save_abort(const char *hook_name)
+void handle_vlock_save_abort(size_t hook)
 {
   list_for_each_reverse(plugins, plugin_item) {
     struct plugin *p = plugin_item->data;
@@ -420,7 +854,7 @@ void handle_vlock_save_abort(const char *hook_name)
     if (p->save_disabled)
       continue;
 
-    if (!call_hook(p, hook_name))
+    if (!watch_hook(p, hook))
       p->save_disabled = true;
   }
 }
@@ -13,13 +13,25 @@
 
 #include <stdbool.h>
 
-/* Load the named plugin. */
+/* Load the named plugin.  Script plugins are only started here, their
+ * dependencies are read by resolve_dependencies() for all plugins at once.
+ * Errors that happen there are reported by resolve_dependencies(). */
 bool load_plugin(const char *name);
 
 /* Resolve all the dependencies between all plugins.  This function *must* be
  * called after all plugins were loaded.  This function aborts on error. */
 bool resolve_dependencies(void);
 
+/* Check that the real user may use all loaded plugins.  This is needed if the
+ * user was changed after the plugins were loaded.  Prints a message and
+ * returns false if not. */
+bool check_plugins(void);
+
+/* Prepare all plugins for calling their hooks.  The lock service does this
+ * once before it forks its clients.  Returns false if a plugin could not be
+ * opened. */
+bool open_plugins(void);
+
 /* Unload all plugins. */
 void unload_plugins(void);
 
@@ -11,119 +11,314 @@
  *
  */
 
+#if !defined(__FreeBSD__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
 #include <stdio.h>
+#include <stdlib.h>
 #include <unistd.h>
+#include <limits.h>
 #include <signal.h>
 #include <sys/wait.h>
 #include <sys/resource.h>
-#include <sys/time.h>
+#include <sys/syscall.h>
 #include <fcntl.h>
-#include <sys/select.h>
+#include <poll.h>
+#include <time.h>
+#include <spawn.h>
 #include <errno.h>
 
 #include "process.h"
+#include "util.h"
+
+/* posix_spawn() can only be used if it can close all other descriptors. */
+#if defined(__GLIBC_PREREQ)
+#if __GLIBC_PREREQ(2, 34)
+#define HAVE_SPAWN_CLOSEFROM
+#endif
+#endif
+
+/* A child process that is supervised by wait_for_children() and
+ * ensure_children_death().  The process file descriptor refers to the child
+ * even after its PID was reused, so signals never reach the wrong process.
+ * If the kernel has no process file descriptors pidfd is -1 and the children
+ * are polled with waitpid(). */
+struct supervised_child
+{
+  pid_t *pid;
+  int pidfd;
+};
+
+/* Interval in which children are polled without process file descriptors. */
+#define POLL_INTERVAL_NS 10000000L
 
-/* Do nothing. */
-static void ignore_sigalarm(int __attribute__((unused)) signum)
+/* Reap the given child if it died.  Returns true if it was reaped or is not
+ * a child of this process. */
+static bool reap_child(struct supervised_child *child)
 {
+  int status;
+
+  if (waitpid(*child->pid, &status, WNOHANG) == 0)
+    return false;
+
+  *child->pid = 0;
+
+  if (child->pidfd >= 0) {
+    (void) close(child->pidfd);
+    child->pidfd = -1;
+  }
+
+  return true;
 }
 
-bool wait_for_death(pid_t pid, long sec, long usec)
+/* Fill the given array with the children that are still alive.  Returns the
+ * number of children. */
+static size_t supervise_children(pid_t *pids, size_t nr_pids,
+    struct supervised_child *children)
 {
-  int status;
-  struct sigaction act;
-  struct sigaction oldact;
-  struct itimerval timer;
-  struct itimerval otimer;
-  bool result;
+  size_t nr_children = 0;
 
-  /* Ignore SIGALRM.  The handler must be a real function instead of SIG_IGN
-   * otherwise waitpid() would not get interrupted.
-   *
-   * There is a small window here where a previously set alarm might be
-   * ignored.  */
-  sigemptyset(&act.sa_mask);
-  act.sa_handler = ignore_sigalarm;
-  act.sa_flags = 0;
-  sigaction(SIGALRM, &act, &oldact);
+  for (size_t i = 0; i < nr_pids; i++) {
+    struct supervised_child *child = &children[nr_children];
 
-  /* Initialize the timer. */
-  timer.it_value.tv_sec = sec;
-  timer.it_value.tv_usec = usec;
-  /* No repetition. */
-  timer.it_interval.tv_sec = 0;
-  timer.it_interval.tv_usec = 0;
+    if (pids[i] <= 0)
+      continue;
 
-  /* Set the timer. */
-  setitimer(ITIMER_REAL, &timer, &otimer);
+    child->pid = &pids[i];
+#ifdef SYS_pidfd_open
+    child->pidfd = syscall(SYS_pidfd_open, pids[i], 0);
+#else
+    child->pidfd = -1;
+#endif
 
-  /* Wait until the child exits or the timer fires. */
-  result = (waitpid(pid, &status, 0) == pid);
+    if (!reap_child(child))
+      nr_children++;
+  }
 
-  /* Possible race condition.  If an alarm was set before it may get ignored.
-   * This is probably better than getting killed by our own alarm. */
+  return nr_children;
+}
 
-  /* Restore the timer. */
-  setitimer(ITIMER_REAL, &otimer, NULL);
+static void release_children(struct supervised_child *children,
+    size_t nr_children)
+{
+  for (size_t i = 0; i < nr_children; i++)
+    if (children[i].pidfd >= 0)
+      (void) close(children[i].pidfd);
+}
 
-  /* Restore signal handler for SIGALRM. */
-  sigaction(SIGALRM, &oldact, NULL);
+static void signal_child(struct supervised_child *child, int signum)
+{
+#ifdef SYS_pidfd_send_signal
+  if (child->pidfd >= 0
+      && syscall(SYS_pidfd_send_signal, child->pidfd, signum, NULL, 0) == 0)
+    return;
+#endif
 
-  return result;
+  (void) kill(*child->pid, signum);
 }
 
-/* Try hard to kill the given child process. */
-void ensure_death(pid_t pid)
+/* Wait until all children died or the deadline passed.  Dead children are
+ * removed from the array.  Returns the number of children that are still
+ * alive. */
+static size_t wait_until(struct supervised_child *children,
+    size_t nr_children, const struct timespec *deadline)
 {
-  int status;
+  struct timespec remaining;
+
+  while (nr_children > 0 && get_remaining(deadline, &remaining)) {
+    struct pollfd fds[nr_children];
+    bool have_pidfds = true;
+
+    for (size_t i = 0; i < nr_children; i++) {
+      fds[i].fd = children[i].pidfd;
+      fds[i].events = POLLIN;
+      have_pidfds = have_pidfds && children[i].pidfd >= 0;
+    }
+
+    if (have_pidfds) {
+      /* A process file descriptor becomes readable when the process exits.
+       * The timeout is rounded up to whole milliseconds. */
+      int timeout = remaining.tv_sec < INT_MAX / 1000 - 1
+        ? remaining.tv_sec * 1000 + (remaining.tv_nsec + 999999L) / 1000000L
+        : INT_MAX;
 
-  switch (waitpid(pid, &status, WNOHANG)) {
-    case -1:
-      /* Not your child? */
-      return;
-    case 0:
-      /* Not dead yet.  Continue. */
-      break;
-    default:
-      /* Already dead.  Nothing to do. */
-      return;
+      (void) poll(fds, nr_children, timeout);
+    } else {
+      if (remaining.tv_sec > 0 || remaining.tv_nsec > POLL_INTERVAL_NS) {
+        remaining.tv_sec = 0;
+        remaining.tv_nsec = POLL_INTERVAL_NS;
+      }
+
+      (void) nanosleep(&remaining, NULL);
+    }
+
+    for (size_t i = 0; i < nr_children;) {
+      if (reap_child(&children[i]))
+        children[i] = children[--nr_children];
+      else
+        i++;
+    }
   }
 
+  return nr_children;
+}
+
+bool wait_for_children(pid_t *pids, size_t nr_pids,
+    const struct timespec *timeout)
+{
+  struct supervised_child children[nr_pids > 0 ? nr_pids : 1];
+  size_t nr_children = supervise_children(pids, nr_pids, children);
+  struct timespec deadline;
+
+  if (timeout == NULL) {
+    /* Wait forever. */
+    for (size_t i = 0; i < nr_children; i++) {
+      int status;
+
+      if (waitpid(*children[i].pid, &status, 0) == *children[i].pid)
+        *children[i].pid = 0;
+    }
+
+    release_children(children, nr_children);
+
+    for (size_t i = 0; i < nr_pids; i++)
+      if (pids[i] != 0)
+        return false;
+
+    return true;
+  }
+
+  get_deadline(timeout, &deadline);
+  nr_children = wait_until(children, nr_children, &deadline);
+  release_children(children, nr_children);
+
+  return nr_children == 0;
+}
+
+bool wait_for_death(pid_t pid, const struct timespec *timeout)
+{
+  return wait_for_children(&pid, 1, timeout);
+}
+
+void ensure_children_death(pid_t *pids, size_t nr_pids)
+{
+  static const struct timespec term_timeout = { 0, 500000000L };
+  struct supervised_child children[nr_pids > 0 ? nr_pids : 1];
+  size_t nr_children = supervise_children(pids, nr_pids, children);
+  struct timespec deadline;
+
   /* Send SIGTERM. */
-  (void) kill(pid, SIGTERM);
+  for (size_t i = 0; i < nr_children; i++)
+    signal_child(&children[i], SIGTERM);
 
-  /* SIGTERM handler (if any) has 500ms to finish. */
-  if (wait_for_death(pid, 0, 500000L))
-    return;
+  /* SIGTERM handlers (if any) have 500ms to finish. */
+  get_deadline(&term_timeout, &deadline);
+  nr_children = wait_until(children, nr_children, &deadline);
 
-  // Send SIGKILL. */
-  (void) kill(pid, SIGKILL);
-  /* Child may be stopped.  Send SIGCONT just to be sure. */
-  (void) kill(pid, SIGCONT);
+  for (size_t i = 0; i < nr_children; i++) {
+    int status;
 
-  /* Wait until dead.  Shouldn't take long. */
-  (void) waitpid(pid, &status, 0);
+    /* Send SIGKILL. */
+    signal_child(&children[i], SIGKILL);
+    /* Child may be stopped.  Send SIGCONT just to be sure. */
+    signal_child(&children[i], SIGCONT);
+
+    /* Wait until dead.  Shouldn't take long. */
+    (void) waitpid(*children[i].pid, &status, 0);
+    *children[i].pid = 0;
+  }
+
+  release_children(children, nr_children);
+}
+
+void ensure_death(pid_t pid)
+{
+  ensure_children_death(&pid, 1);
 }
 
-/* Close all possibly open file descriptors except the ones specified in the
- * given set. */
-static void close_fds(fd_set *except_fds)
+#if defined(__linux__) && defined(SYS_getdents64)
+/* Close the open file descriptors from first to last by reading
+ * /proc/self/fd.  The directory is read with the system call because the
+ * child of a fork() should not allocate memory.  Returns false if the
+ * directory cannot be read. */
+static bool close_fds_from_proc(int first, int last)
+{
+  char buffer[4096];
+  long length;
+  int dir_fd = open("/proc/self/fd", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+
+  if (dir_fd < 0)
+    return false;
+
+  while ((length = syscall(SYS_getdents64, dir_fd, buffer, sizeof buffer)) > 0) {
+    for (long offset = 0; offset < length;) {
+      /* struct linux_dirent64 is not in any header. */
+      struct {
+        unsigned long long d_ino;
+        long long d_off;
+        unsigned short d_reclen;
+        unsigned char d_type;
+        char d_name[];
+      } *entry = (void *) (buffer + offset);
+      char *end;
+      long fd = strtol(entry->d_name, &end, 10);
+
+      /* Closing does not change the entries that are still to be read. */
+      if (*end == '\0' && end != entry->d_name
+          && fd >= first && fd <= last && fd != dir_fd)
+        (void) close(fd);
+
+      offset += entry->d_reclen;
+    }
+  }
+
+  (void) close(dir_fd);
+
+  return length == 0;
+}
+#endif
+
+/* Close all file descriptors from first to last. */
+static void close_fd_range(int first, int last)
 {
   struct rlimit r;
   int maxfd;
 
+  if (first > last)
+    return;
+
+#ifdef SYS_close_range
+  if (syscall(SYS_close_range, (unsigned int) first, (unsigned int) last, 0) == 0)
+    return;
+#endif
+
+#if defined(__linux__) && defined(SYS_getdents64)
+  if (close_fds_from_proc(first, last))
+    return;
+#endif
+
   /* Get the maximum number of file descriptors. */
-  if (getrlimit(RLIMIT_NOFILE, &r) == 0)
+  if (getrlimit(RLIMIT_NOFILE, &r) == 0 && r.rlim_cur != RLIM_INFINITY)
     maxfd = r.rlim_cur;
   else
     /* Hopefully safe default. */
     maxfd = 1024;
 
-  /* Close all possibly open file descriptors except STDIN_FILENO,
-   * STDOUT_FILENO and STDERR_FILENO. */
-  for (int fd = 0; fd < maxfd; fd++)
-    if (!FD_ISSET(fd, except_fds))
-      (void) close(fd);
+  for (int fd = first; fd <= last && fd < maxfd; fd++)
+    (void) close(fd);
+}
+
+/* Close all possibly open file descriptors except STDIN_FILENO,
+ * STDOUT_FILENO, STDERR_FILENO and the given one. */
+static void close_fds(int except_fd)
+{
+  if (except_fd > STDERR_FILENO) {
+    close_fd_range(STDERR_FILENO + 1, except_fd - 1);
+    close_fd_range(except_fd + 1, INT_MAX);
+  } else {
+    close_fd_range(STDERR_FILENO + 1, INT_MAX);
+  }
 }
 
 static int open_devnull(void)
@@ -131,80 +326,45 @@ static int open_devnull(void)
   static int devnull_fd = -1;
 
   if (devnull_fd < 0)
-    devnull_fd = open("/dev/null", O_RDWR);
+    devnull_fd = open("/dev/null", O_RDWR | O_CLOEXEC);
 
   return devnull_fd;
 }
 
-bool create_child(struct child_process *child)
+/* Redirect the given stdio descriptor of the child.  The source is a
+ * descriptor or one of the special values. */
+static void redirect_fd(int source, int target)
+{
+  if (source == REDIRECT_DEV_NULL)
+    (void) dup2(open_devnull(), target);
+  else if (source != NO_REDIRECT)
+    (void) dup2(source, target);
+}
+
+/* Create the child with fork().  This is needed if a function should be run
+ * in the child.  The stdio descriptors are given as for redirect_fd(). */
+static bool fork_child(struct child_process *child, const int stdio_fds[3])
 {
-  int errsv;
   int child_errno = 0;
   int status_pipe[2];
-  int stdin_pipe[2];
-  int stdout_pipe[2];
-  int stderr_pipe[2];
+  sigset_t no_signals;
 
-  if (pipe(status_pipe) < 0)
+  if (pipe2(status_pipe, O_CLOEXEC) < 0)
     return false;
 
-  (void) fcntl(status_pipe[1], F_SETFD, FD_CLOEXEC);
-
-  if (child->stdin_fd == REDIRECT_PIPE) {
-    if (pipe(stdin_pipe) < 0) {
-      errsv = errno;
-      goto stdin_pipe_failed;
-    }
-  } 
-
-  if (child->stdout_fd == REDIRECT_PIPE) {
-    if (pipe(stdout_pipe) < 0) {
-      errsv = errno;
-      goto stdout_pipe_failed;
-    }
-  }
-
-  if (child->stderr_fd == REDIRECT_PIPE) {
-    if (pipe(stderr_pipe) < 0) {
-      errsv = errno;
-      goto stderr_pipe_failed;
-    }
-  }
-
   child->pid = fork();
 
   if (child->pid == 0) {
     /* Child. */
-    fd_set except_fds;
-
-    if (child->stdin_fd == REDIRECT_PIPE)
-      (void) dup2(stdin_pipe[0], STDIN_FILENO);
-    else if (child->stdin_fd == REDIRECT_DEV_NULL)
-      (void) dup2(open_devnull(), STDIN_FILENO);
-    else if (child->stdin_fd != NO_REDIRECT)
-      (void) dup2(child->stdin_fd, STDIN_FILENO);
-
-    if (child->stdout_fd == REDIRECT_PIPE)
-      (void) dup2(stdout_pipe[1], STDOUT_FILENO);
-    else if (child->stdout_fd == REDIRECT_DEV_NULL)
-      (void) dup2(open_devnull(), STDOUT_FILENO);
-    else if (child->stdout_fd != NO_REDIRECT)
-      (void) dup2(child->stdout_fd, STDOUT_FILENO);
-
-    if (child->stderr_fd == REDIRECT_PIPE)
-      (void) dup2(stderr_pipe[1], STDERR_FILENO);
-    else if (child->stderr_fd == REDIRECT_DEV_NULL)
-      (void) dup2(open_devnull(), STDERR_FILENO);
-    else if (child->stderr_fd != NO_REDIRECT)
-      (void) dup2(child->stderr_fd, STDERR_FILENO);
-
-    FD_ZERO(&except_fds);
-    FD_SET(STDIN_FILENO, &except_fds);
-    FD_SET(STDOUT_FILENO, &except_fds);
-    FD_SET(STDERR_FILENO, &except_fds);
-    FD_SET(status_pipe[1], &except_fds);
-
-    (void) close_fds(&except_fds);
+    redirect_fd(stdio_fds[0], STDIN_FILENO);
+    redirect_fd(stdio_fds[1], STDOUT_FILENO);
+    redirect_fd(stdio_fds[2], STDERR_FILENO);
+
+    close_fds(status_pipe[1]);
+
+    /* The signals read by the event loop are blocked. */
+    (void) sigemptyset(&no_signals);
+    (void) sigprocmask(SIG_SETMASK, &no_signals, NULL);
 
     (void) setgid(getgid());
     (void) setuid(getuid());
@@ -221,20 +381,130 @@ bool create_child(struct child_process *child)
   }
 
   if (child->pid < 0) {
-    errsv = errno;
-    goto fork_failed;
+    GUARD_ERRNO((void) close(status_pipe[0]));
+    GUARD_ERRNO((void) close(status_pipe[1]));
+    return false;
   }
 
   (void) close(status_pipe[1]);
 
   /* Get the error status from the child, if any. */
   if (read(status_pipe[0], &child_errno, sizeof child_errno) == sizeof child_errno) {
-    errsv = child_errno;
-    goto child_failed;
+    (void) close(status_pipe[0]);
+    (void) waitpid(child->pid, NULL, 0);
+    errno = child_errno;
+    return false;
   }
 
   (void) close(status_pipe[0]);
 
+  return true;
+}
+
+#ifdef HAVE_SPAWN_CLOSEFROM
+/* Create the child with posix_spawn().  This does not copy the address space
+ * of vlock-main and reports exec failure directly.  The file actions do what
+ * fork_child() does in the child, the effective IDs are reset to the real
+ * ones, which become the saved IDs on exec. */
+static bool spawn_child(struct child_process *child, const int stdio_fds[3])
+{
+  posix_spawn_file_actions_t actions;
+  posix_spawnattr_t attr;
+  sigset_t no_signals;
+  int result;
+
+  result = posix_spawn_file_actions_init(&actions);
+
+  if (result != 0) {
+    errno = result;
+    return false;
+  }
+
+  result = posix_spawnattr_init(&attr);
+
+  if (result != 0) {
+    (void) posix_spawn_file_actions_destroy(&actions);
+    errno = result;
+    return false;
+  }
+
+  for (int target = STDIN_FILENO; target <= STDERR_FILENO && result == 0; target++) {
+    if (stdio_fds[target] == REDIRECT_DEV_NULL)
+      result = posix_spawn_file_actions_addopen(&actions, target, "/dev/null", O_RDWR, 0);
+    else if (stdio_fds[target] != NO_REDIRECT)
+      result = posix_spawn_file_actions_adddup2(&actions, stdio_fds[target], target);
+  }
+
+  if (result == 0)
+    result = posix_spawn_file_actions_addclosefrom_np(&actions, STDERR_FILENO + 1);
+
+  /* The signals read by the event loop are blocked. */
+  (void) sigemptyset(&no_signals);
+
+  if (result == 0)
+    result = posix_spawnattr_setsigmask(&attr, &no_signals);
+
+  if (result == 0)
+    result = posix_spawnattr_setflags(&attr, POSIX_SPAWN_RESETIDS | POSIX_SPAWN_SETSIGMASK);
+
+  if (result == 0)
+    result = posix_spawn(&child->pid, child->path, &actions, &attr,
+        (char *const *) child->argv, environ);
+
+  (void) posix_spawnattr_destroy(&attr);
+  (void) posix_spawn_file_actions_destroy(&actions);
+
+  if (result != 0) {
+    errno = result;
+    return false;
+  }
+
+  return true;
+}
+#endif
+
+bool create_child(struct child_process *child)
+{
+  int errsv;
+  int stdin_pipe[2] = { -1, -1 };
+  int stdout_pipe[2] = { -1, -1 };
+  int stderr_pipe[2] = { -1, -1 };
+  int stdio_fds[3] = { child->stdin_fd, child->stdout_fd, child->stderr_fd };
+  bool result;
+
+  /* All pipes are closed on exec.  The child's ends are duplicated to the
+   * standard file descriptors which clears the flag. */
+  if (child->stdin_fd == REDIRECT_PIPE) {
+    if (pipe2(stdin_pipe, O_CLOEXEC) < 0)
+      goto error;
+
+    stdio_fds[0] = stdin_pipe[0];
+  }
+
+  if (child->stdout_fd == REDIRECT_PIPE) {
+    if (pipe2(stdout_pipe, O_CLOEXEC) < 0)
+      goto error;
+
+    stdio_fds[1] = stdout_pipe[1];
+  }
+
+  if (child->stderr_fd == REDIRECT_PIPE) {
+    if (pipe2(stderr_pipe, O_CLOEXEC) < 0)
+      goto error;
+
+    stdio_fds[2] = stderr_pipe[1];
+  }
+
+#ifdef HAVE_SPAWN_CLOSEFROM
+  if (child->function == NULL)
+    result = spawn_child(child, stdio_fds);
+  else
+#endif
+    result = fork_child(child, stdio_fds);
+
+  if (!result)
+    goto error;
+
   if (child->stdin_fd == REDIRECT_PIPE) {
     /* Write end. */
     child->stdin_fd = stdin_pipe[1];
@@ -258,28 +528,19 @@ bool create_child(struct child_process *child)
 
   return true;
 
-child_failed:
-fork_failed:
-  if (child->stderr_fd == REDIRECT_PIPE) {
-    (void) close(stderr_pipe[0]);
-    (void) close(stderr_pipe[1]);
-  }
+error:
+  errsv = errno;
 
-stderr_pipe_failed:
-  if (child->stdout_fd == REDIRECT_PIPE) {
-    (void) close(stdout_pipe[0]);
-    (void) close(stdout_pipe[1]);
-  }
+  for (int i = 0; i < 2; i++) {
+    if (stdin_pipe[i] >= 0)
+      (void) close(stdin_pipe[i]);
 
-stdout_pipe_failed:
-  if (child->stdin_fd == REDIRECT_PIPE) {
-    (void) close(stdin_pipe[0]);
-    (void) close(stdin_pipe[1]);
-  }
+    if (stdout_pipe[i] >= 0)
+      (void) close(stdout_pipe[i]);
 
-stdin_pipe_failed:
-  (void) close(status_pipe[0]);
-  (void) close(status_pipe[1]);
+    if (stderr_pipe[i] >= 0)
+      (void) close(stderr_pipe[i]);
+  }
 
   errno = errsv;
 
@@ -12,14 +12,30 @@
  */
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <sys/types.h>
 
-/* Wait for the given amount of time for the death of the given child process.
- * If the child process dies in the given amount of time or already was dead
- * true is returned and false otherwise. */
-bool wait_for_death(pid_t pid, long sec, long usec);
+struct timespec;
 
-/* Try hard to kill the given child process. */
+/* Wait for the given amount of time for the death of all of the given child
+ * processes.  Children that died are reaped and their PID is set to 0, as is
+ * the PID of processes that are not children of this process.  Entries that
+ * are 0 already are skipped.  If all children die in the given amount of time
+ * or already were dead true is returned and false otherwise.  A timeout of
+ * NULL waits until all children died.  No signal handlers or timers are
+ * used. */
+bool wait_for_children(pid_t *pids, size_t nr_pids,
+    const struct timespec *timeout);
+
+/* Like wait_for_children() for a single child process. */
+bool wait_for_death(pid_t pid, const struct timespec *timeout);
+
+/* Try hard to kill the given child processes.  They are sent SIGTERM and
+ * have 500ms to exit before they are killed.  All of them are reaped and
+ * their PIDs set to 0. */
+void ensure_children_death(pid_t *pids, size_t nr_pids);
+
+/* Like ensure_children_death() for a single child process. */
 void ensure_death(pid_t pid);
 
 #define NO_REDIRECT (-2)
@@ -46,13 +46,189 @@
 #include <string.h>
 #include <termios.h>
 #include <unistd.h>
-#include <sys/select.h>
 #include <errno.h>
+#include <sys/uio.h>
 
+#include "event.h"
 #include "prompt.h"
+#include "terminal.h"
+#include "util.h"
 
 #define PROMPT_BUFFER_SIZE 512
 
+/* Input that was read from stdin but not consumed yet.  Everything that is
+ * available is read at once, so a paste or a barcode scanner flooding the
+ * terminal costs one read() per chunk instead of one per character.  The size
+ * must be a power of two. */
+#define INPUT_BUFFER_SIZE 4096
+
+static struct
+{
+  char data[INPUT_BUFFER_SIZE];
+  /* Index of the first unread byte. */
+  size_t start;
+  /* Number of unread bytes. */
+  size_t length;
+} input;
+
+/* Remove the given number of bytes from the front of the input buffer.  They
+ * are overwritten because they may be part of a password. */
+static void consume_input(size_t count)
+{
+  size_t first = INPUT_BUFFER_SIZE - input.start;
+
+  if (first > count)
+    first = count;
+
+  memset(input.data + input.start, 0, first);
+  memset(input.data, 0, count - first);
+
+  input.start = (input.start + count) & (INPUT_BUFFER_SIZE - 1);
+  input.length -= count;
+}
+
+/* Read whatever is available on stdin into the free space of the input
+ * buffer with a single system call.  Returns the number of bytes read, 0 on
+ * end-of-file or -1 on error. */
+static ssize_t fill_input(void)
+{
+  size_t end = (input.start + input.length) & (INPUT_BUFFER_SIZE - 1);
+  size_t space = INPUT_BUFFER_SIZE - input.length;
+  struct iovec iov[2];
+  ssize_t length;
+
+  if (space == 0) {
+    errno = ENOBUFS;
+    return -1;
+  }
+
+  /* The free space wraps around the end of the buffer. */
+  iov[0].iov_base = input.data + end;
+  iov[0].iov_len = end >= input.start ? INPUT_BUFFER_SIZE - end : space;
+  iov[1].iov_base = input.data;
+  iov[1].iov_len = space - iov[0].iov_len;
+
+  length = readv(STDIN_FILENO, iov, iov[1].iov_len > 0 ? 2 : 1);
+
+  if (length > 0)
+    input.length += length;
+
+  return length;
+}
+
+/* Find the first buffered character that is in the given character set, or
+ * any character if charset is NULL.  The character and everything before it
+ * is consumed.  If there is no such character all buffered input is consumed
+ * and 0 is returned. */
+static char take_character(const char *charset)
+{
+  size_t first_length = INPUT_BUFFER_SIZE - input.start;
+  size_t position = input.length;
+  char c;
+
+  if (first_length > input.length)
+    first_length = input.length;
+
+  if (charset == NULL) {
+    position = 0;
+  } else {
+    /* Search both parts of the buffer for every character of the set. */
+    for (const char *s = charset; *s != '\0'; s++) {
+      const char *found = memchr(input.data + input.start, *s,
+          first_length < position ? first_length : position);
+
+      if (found != NULL) {
+        position = found - (input.data + input.start);
+      } else if (position > first_length) {
+        found = memchr(input.data, *s, position - first_length);
+
+        if (found != NULL)
+          position = first_length + (found - input.data);
+      }
+    }
+  }
+
+  if (position >= input.length) {
+    consume_input(input.length);
+    return 0;
+  }
+
+  c = input.data[(input.start + position) & (INPUT_BUFFER_SIZE - 1)];
+  consume_input(position + 1);
+
+  return c;
+}
+
+/* Waiting for input on stdin with an optional timeout through the event
+ * loop. */
+struct input_wait
+{
+  struct event_source *input;
+  struct event_source *timer;
+  bool done;
+  bool timed_out;
+};
+
+static void input_ready(void *data)
+{
+  struct input_wait *w = data;
+  w->done = true;
+}
+
+static void input_timeout(void *data)
+{
+  struct input_wait *w = data;
+  w->done = true;
+  w->timed_out = true;
+}
+
+/* Start watching stdin and the timeout (if given).  Returns false and sets
+ * errno on error. */
+static bool start_waiting(struct input_wait *w, const struct timespec *timeout)
+{
+  w->done = false;
+  w->timed_out = false;
+  w->timer = NULL;
+  w->input = event_watch_fd(STDIN_FILENO, input_ready, w);
+
+  if (w->input == NULL)
+    return false;
+
+  if (timeout != NULL) {
+    w->timer = event_add_timer(timeout, input_timeout, w);
+
+    if (w->timer == NULL) {
+      GUARD_ERRNO(event_remove(w->input));
+      return false;
+    }
+  }
+
+  return true;
+}
+
+static void stop_waiting(struct input_wait *w)
+{
+  event_remove(w->timer);
+  event_remove(w->input);
+}
+
+/* Wait until stdin becomes readable.  Returns false if the timeout occurred,
+ * with errno set to 0, or on error. */
+static bool wait_for_input(struct input_wait *w)
+{
+  w->done = false;
+
+  if (!event_loop(&w->done))
+    return false;
+
+  if (w->timed_out) {
+    errno = 0;
+    return false;
+  }
+
+  return true;
+}
+
 /* Prompt with the given string for a single line of input.  The read string is
  * returned in a new buffer that should be freed by the caller.  If reading
  * fails or the timeout (if given) occurs NULL is retured. */
@@ -61,65 +237,41 @@ char *prompt(const char *msg, const struct timespec *timeout)
   char buffer[PROMPT_BUFFER_SIZE];
   char *result = NULL;
   ssize_t len;
-  struct termios term;
-  struct timeval *timeout_val = NULL;
+  struct input_wait w;
   tcflag_t lflag;
-  fd_set readfds;
 
+  /* Enable canonical mode.  We're only interested in line buffering.  Disable
+   * terminal signals. */
+  lflag = terminal_set_lflag(ICANON, ISIG);
+  /* Set the terminal attributes and discard all unread input characters. */
+  (void) terminal_apply(true);
+  consume_input(input.length);
+
+  /* Write out the prompt only after old input was discarded.  Otherwise
+   * anything typed right after the prompt appears might get lost. */
   if (msg != NULL) {
-    /* Write out the prompt. */
     (void) fputs(msg, stderr);
     fflush(stderr);
   }
 
-  /* Get the current terminal attributes. */
-  (void) tcgetattr(STDIN_FILENO, &term);
-  /* Save the lflag value. */
-  lflag = term.c_lflag;
-  /* Enable canonical mode.  We're only interested in line buffering. */
-  term.c_lflag |= ICANON;
-  /* Disable terminal signals. */
-  term.c_lflag &= ~ISIG;
-  /* Set the terminal attributes. */
-  (void) tcsetattr(STDIN_FILENO, TCSAFLUSH, &term);
-  /* Discard all unread input characters. */
-  (void) tcflush(STDIN_FILENO, TCIFLUSH);
-
-  /* Initialize file descriptor set. */
-  FD_ZERO(&readfds);
-  FD_SET(STDIN_FILENO, &readfds);
-
-
-before_select:
-  /* copy timeout */
-  if (timeout != NULL) {
-    timeout_val = malloc(sizeof *timeout_val);
-
-    if (timeout_val == NULL)
-      return NULL;
-
-    timeout_val->tv_sec = timeout->tv_sec;
-    timeout_val->tv_usec = timeout->tv_nsec / 1000;
+  if (!start_waiting(&w, timeout)) {
+    perror("vlock: waiting for input failed");
+    goto out;
   }
 
-  /* Reset errno. */
-  errno = 0;
-
   /* Wait until a string was entered. */
-  if (select(STDIN_FILENO + 1, &readfds, NULL, NULL, timeout_val) != 1) {
-    switch (errno) {
-      case 0:
-        fprintf(stderr, "timeout!\n");
-        goto out;
-      case EINTR:
-        /* A signal was caught. Restart. */
-        goto before_select;
-      default:
-        perror("vlock: select() on stdin failed");
-        goto out;
-    }
+  if (!wait_for_input(&w)) {
+    if (errno == 0)
+      fprintf(stderr, "timeout!\n");
+    else
+      perror("vlock: waiting for input failed");
+
+    stop_waiting(&w);
+    goto out;
   }
 
+  stop_waiting(&w);
+
   /* Read the string from stdin.  At most buffer length - 1 bytes, to
    * leave room for the terminating zero byte. */
   if ((len = read(STDIN_FILENO, buffer, sizeof buffer - 1)) < 0)
@@ -143,11 +295,9 @@ before_select:
   memset(buffer, 0, sizeof buffer);
 
 out:
-  free(timeout_val);
-
-  /* Restore original terminal attributes. */
-  term.c_lflag = lflag;
-  (void) tcsetattr(STDIN_FILENO, TCSAFLUSH, &term);
+  /* Restore original terminal attributes.  This only takes effect when the
+   * terminal is used again. */
+  terminal_reset_lflag(lflag);
 
   return result;
 }
@@ -155,19 +305,10 @@ out:
 /* Same as prompt except that the characters entered are not echoed. */
 char *prompt_echo_off(const char *msg, const struct timespec *timeout)
 {
-  struct termios term;
-  tcflag_t lflag;
-  char *result;
+  tcflag_t lflag = terminal_set_lflag(0, ECHO);
+  char *result = prompt(msg, timeout);
 
-  (void) tcgetattr(STDIN_FILENO, &term);
-  lflag = term.c_lflag;
-  term.c_lflag &= ~ECHO;
-  (void) tcsetattr(STDIN_FILENO, TCSAFLUSH, &term);
-
-  result = prompt(msg, timeout);
-
-  term.c_lflag = lflag;
-  (void) tcsetattr(STDIN_FILENO, TCSAFLUSH, &term);
+  terminal_reset_lflag(lflag);
 
   if (result != NULL)
     fputc('\n', stderr);
@@ -175,67 +316,63 @@ char *prompt_echo_off(const char *msg, const struct timespec *timeout)
   return result;
 }
 
-/* Read a single character from the stdin.  If the timeout is reached
- * 0 is returned. */
+/* Read a single character from the stdin.  See wait_for_character(). */
 char read_character(struct timespec *timeout)
 {
+  return wait_for_character(NULL, timeout);
+}
+
+/* Wait for any of the characters in the given character set to be read from
+ * stdin.  If charset is NULL wait for any character.  Returns 0 when the
+ * timeout occurs, with errno set to 0, or on error. */
+char wait_for_character(const char *charset, struct timespec *timeout)
+{
+  struct input_wait w;
+  tcflag_t lflag;
+  ssize_t length;
   char c = 0;
-  struct timeval *timeout_val = NULL;
-  fd_set readfds;
 
-  if (timeout != NULL) {
-    timeout_val = calloc(sizeof *timeout_val, 1);
+  /* Input that was read before may already contain the character. */
+  if (input.length > 0) {
+    c = take_character(charset);
 
-    if (timeout_val != NULL) {
-      timeout_val->tv_sec = timeout->tv_sec;
-      timeout_val->tv_usec = timeout->tv_nsec / 1000;
-    }
+    if (c != 0)
+      return c;
   }
 
-  /* Initialize file descriptor set. */
-  FD_ZERO(&readfds);
-  FD_SET(STDIN_FILENO, &readfds);
+  /* switch off line buffering */
+  lflag = terminal_set_lflag(0, ICANON);
+  (void) terminal_apply(false);
 
-  /* Wait for a character. */
-  if (select(STDIN_FILENO + 1, &readfds, NULL, NULL, timeout_val) != 1)
-    goto out;
+  /* Stdin and the timer stay registered while waiting for the right
+   * character. */
+  if (start_waiting(&w, timeout)) {
+    do {
+      if (!wait_for_input(&w))
+        break;
 
-  /* Read the character. */
-  (void) read(STDIN_FILENO, &c, 1);
+      length = fill_input();
 
-out:
-  free(timeout_val);
-  return c;
-}
+      /* Nobody can type anymore if the terminal is gone.  Stdin would be
+       * readable forever. */
+      if (length == 0)
+        errno = EIO;
 
-/* Wait for any of the characters in the given character set to be read from
- * stdin.  If charset is NULL wait for any character.  Returns 0 when the
- * timeout occurs. */
-char wait_for_character(const char *charset, struct timespec *timeout)
-{
-  struct termios term;
-  tcflag_t lflag;
-  char c;
+      if (length <= 0)
+        break;
 
-  /* switch off line buffering */
-  (void) tcgetattr(STDIN_FILENO, &term);
-  lflag = term.c_lflag;
-  term.c_lflag &= ~ICANON;
-  (void) tcsetattr(STDIN_FILENO, TCSANOW, &term);
+      c = take_character(charset);
 
-  for (;;) {
-    c = read_character(timeout);
+      /* Any input restarts the timeout. */
+      if (c == 0 && w.timer != NULL)
+        (void) event_reset_timer(w.timer, timeout);
+    } while (c == 0);
 
-    if (c == 0 || charset == NULL)
-      break;
-    else if (strchr(charset, c) != NULL)
-      break;
+    GUARD_ERRNO(stop_waiting(&w));
   }
 
-  /* restore line buffering */
-  term.c_lflag = lflag;
-  (void) tcsetattr(STDIN_FILENO, TCSANOW, &term);
+  /* restore line buffering, once the terminal is used again */
+  terminal_reset_lflag(lflag);
 
   return c;
 }
-
@@ -52,10 +52,11 @@ char *prompt(const char *msg, const struct timespec *timeout);
 char *prompt_echo_off(const char *msg, const struct timespec *timeout);
 
 /* Read a single character from the stdin.  If the timeout is reached
- * 0 is returned. */
+ * 0 is returned with errno set to 0.  On error, e.g. when the terminal was
+ * hung up, 0 is returned with errno set. */
 char read_character(struct timespec *timeout);
 
 /* Wait for any of the characters in the given character set to be read from
  * stdin.  If charset is NULL wait for any character.  Returns 0 when the
- * timeout occurs. */
+ * timeout occurs or on error like read_character(). */
 char wait_for_character(const char *charset, struct timespec *timeout);
@@ -0,0 +1,511 @@
+/* rcfile.c -- ~/.vlockrc reader for vlock,
+ *             the VT locking program for linux
+ *
+ * This program is copyright (C) 2007 Frank Benkstein, and is free
+ * software which is freely distributable under the terms of the
+ * GNU General Public License version 2, included as the file COPYING in this
+ * distribution.  It is NOT public domain software, and any
+ * redistribution not permitted by the GNU General Public License is
+ * expressly forbidden without prior written permission from
+ * the author.
+ *
+ */
+
+/* The configuration file is a shell script that is sourced by the vlock
+ * wrapper script.  When vlock-main is started directly the file is parsed here
+ * instead.  Only plain variable assignments are supported, i.e. no commands,
+ * no command substitution and no control structures.  This is enough for the
+ * settings documented in vlock(1).  Users who need more should keep using the
+ * wrapper script. */
+
+#if !defined(__FreeBSD__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+
+#include "rcfile.h"
+#include "util.h"
+
+/* Configuration files larger than this are rejected. */
+#define RCFILE_MAX_SIZE 65536
+
+/* Variables assigned in the configuration file.  Those with the VLOCK_ prefix
+ * are exported whether or not the export keyword is used, the others are only
+ * available for expansion. */
+struct variable
+{
+  char *name;
+  char *value;
+  struct variable *next;
+};
+
+/* Growing string buffer for variable values. */
+struct buffer
+{
+  char *data;
+  size_t length;
+  size_t size;
+};
+
+struct parser
+{
+  const char *path;
+  const char *p;
+  int line;
+  struct variable *variables;
+};
+
+static bool buffer_append(struct buffer *b, const char *s, size_t length)
+{
+  if (b->length + length + 1 > b->size) {
+    size_t size = (b->size > 0) ? b->size : 64;
+    char *data;
+
+    while (b->length + length + 1 > size)
+      size *= 2;
+
+    data = realloc(b->data, size);
+
+    if (data == NULL)
+      return false;
+
+    b->data = data;
+    b->size = size;
+  }
+
+  memcpy(b->data + b->length, s, length);
+  b->length += length;
+  b->data[b->length] = '\0';
+
+  return true;
+}
+
+static const char *lookup_variable(struct parser *parser, const char *name)
+{
+  for (struct variable *v = parser->variables; v != NULL; v = v->next)
+    if (strcmp(v->name, name) == 0)
+      return v->value;
+
+  /* These are predefined by the wrapper script, too.  They are not exported
+   * unless the file assigns them. */
+  if (strcmp(name, "CLEAR_SCREEN") == 0)
+    return CLEAR_SCREEN;
+
+  if (strcmp(name, "VLOCK_ENTER_PROMPT") == 0)
+    return VLOCK_ENTER_PROMPT;
+
+  return getenv(name);
+}
+
+static bool assign_variable(struct parser *parser, const char *name,
+    const char *value)
+{
+  struct variable *v;
+
+  for (v = parser->variables; v != NULL; v = v->next)
+    if (strcmp(v->name, name) == 0)
+      break;
+
+  if (v == NULL) {
+    v = calloc(1, sizeof *v);
+
+    if (v == NULL)
+      return false;
+
+    v->name = strdup(name);
+
+    if (v->name == NULL) {
+      free(v);
+      return false;
+    }
+
+    v->next = parser->variables;
+    parser->variables = v;
+  }
+
+  free(v->value);
+  v->value = strdup(value);
+
+  return v->value != NULL;
+}
+
+/* Export the assigned variables to the environment. */
+static bool export_variables(struct parser *parser)
+{
+  for (struct variable *v = parser->variables; v != NULL; v = v->next)
+    /* Only export vlock's own variables.  Everything else might influence
+     * the privileged process or its children in unexpected ways. */
+    if (strncmp(v->name, "VLOCK_", 6) == 0)
+      if (setenv(v->name, v->value, 1) < 0)
+        return false;
+
+  return true;
+}
+
+static void free_variables(struct parser *parser)
+{
+  while (parser->variables != NULL) {
+    struct variable *v = parser->variables;
+    parser->variables = v->next;
+    free(v->name);
+    free(v->value);
+    free(v);
+  }
+}
+
+static bool is_name_start(char c)
+{
+  return isalpha((unsigned char) c) || c == '_';
+}
+
+static bool is_name_char(char c)
+{
+  return isalnum((unsigned char) c) || c == '_';
+}
+
+/* Skip everything up to and including the next newline. */
+static void skip_line(struct parser *parser)
+{
+  while (*parser->p != '\0' && *parser->p != '\n')
+    parser->p++;
+
+  if (*parser->p == '\n') {
+    parser->p++;
+    parser->line++;
+  }
+}
+
+static void unsupported(struct parser *parser)
+{
+  fprintf(stderr, "vlock: %s:%d: unsupported syntax, file ignored\n",
+      parser->path, parser->line);
+  fprintf(stderr, "vlock: use the vlock wrapper script to read this file\n");
+  errno = 0;
+}
+
+/* Expand the variable reference at the current position, which is just
+ * after the '$'.  Returns false on unsupported syntax. */
+static bool expand_variable(struct parser *parser, struct buffer *b)
+{
+  char name[128];
+  size_t length = 0;
+  bool braced = (*parser->p == '{');
+  const char *value;
+
+  if (braced)
+    parser->p++;
+  else if (!is_name_start(*parser->p))
+    /* Not a variable reference, e.g. "$(" or a lone "$". */
+    return *parser->p != '(' && buffer_append(b, "$", 1);
+
+  while (is_name_char(*parser->p)) {
+    if (length + 1 >= sizeof name)
+      return false;
+
+    name[length++] = *parser->p++;
+  }
+
+  name[length] = '\0';
+
+  if (braced) {
+    if (*parser->p != '}' || length == 0)
+      return false;
+
+    parser->p++;
+  }
+
+  value = lookup_variable(parser, name);
+
+  if (value != NULL)
+    return buffer_append(b, value, strlen(value));
+
+  return true;
+}
+
+/* Parse a variable value up to the first unquoted blank, semicolon or newline.
+ * Returns false on unsupported syntax or error. */
+static bool parse_value(struct parser *parser, struct buffer *b)
+{
+  for (;;) {
+    char c = *parser->p;
+
+    switch (c) {
+      case '\0':
+      case ' ':
+      case '\t':
+      case '\n':
+      case ';':
+        return true;
+      case '`':
+        return false;
+      case '$':
+        parser->p++;
+        if (!expand_variable(parser, b))
+          return false;
+        break;
+      case '\\':
+        parser->p++;
+        if (*parser->p == '\n') {
+          /* Line continuation. */
+          parser->line++;
+          parser->p++;
+        } else if (*parser->p != '\0') {
+          if (!buffer_append(b, parser->p++, 1))
+            return false;
+        }
+        break;
+      case '\'':
+        {
+          const char *end = strchr(++parser->p, '\'');
+
+          if (end == NULL)
+            return false;
+
+          for (const char *q = parser->p; q < end; q++)
+            if (*q == '\n')
+              parser->line++;
+
+          if (!buffer_append(b, parser->p, end - parser->p))
+            return false;
+
+          parser->p = end + 1;
+        }
+        break;
+      case '"':
+        parser->p++;
+
+        while (*parser->p != '"') {
+          c = *parser->p;
+
+          if (c == '\0' || c == '`') {
+            return false;
+          } else if (c == '$') {
+            parser->p++;
+            if (!expand_variable(parser, b))
+              return false;
+          } else if (c == '\\' && parser->p[1] != '\0'
+              && strchr("$`\"\\\n", parser->p[1]) != NULL) {
+            if (parser->p[1] == '\n')
+              parser->line++;
+            else if (!buffer_append(b, parser->p + 1, 1))
+              return false;
+
+            parser->p += 2;
+          } else {
+            if (c == '\n')
+              parser->line++;
+
+            if (!buffer_append(b, parser->p++, 1))
+              return false;
+          }
+        }
+
+        parser->p++;
+        break;
+      default:
+        if (!buffer_append(b, parser->p++, 1))
+          return false;
+        break;
+    }
+  }
+}
+
+/* Parse a single statement.  Returns false on error or unsupported syntax. */
+static bool parse_statement(struct parser *parser)
+{
+  char name[128];
+  size_t length = 0;
+  struct buffer value = { NULL, 0, 0 };
+  bool exported = false;
+  bool result = true;
+
+  /* Skip the export keyword. */
+  if (strncmp(parser->p, "export", 6) == 0
+      && (parser->p[6] == ' ' || parser->p[6] == '\t')) {
+    exported = true;
+    parser->p += 6;
+
+    while (*parser->p == ' ' || *parser->p == '\t')
+      parser->p++;
+  }
+
+  if (!is_name_start(*parser->p))
+    goto unsupported;
+
+  while (is_name_char(*parser->p)) {
+    if (length + 1 >= sizeof name)
+      goto unsupported;
+
+    name[length++] = *parser->p++;
+  }
+
+  name[length] = '\0';
+
+  /* "export NAME" without assignment is ignored. */
+  if (exported && (*parser->p == '\n' || *parser->p == '\0' || *parser->p == ';'))
+    goto out;
+
+  if (*parser->p != '=')
+    goto unsupported;
+
+  parser->p++;
+
+  /* Make sure empty values are terminated. */
+  if (!buffer_append(&value, "", 0)) {
+    result = false;
+    goto out;
+  }
+
+  if (!parse_value(parser, &value)) {
+    if (errno == ENOMEM) {
+      result = false;
+      goto out;
+    }
+
+    goto unsupported;
+  }
+
+  while (*parser->p == ' ' || *parser->p == '\t')
+    parser->p++;
+
+  /* Only comments may follow an assignment on the same line. */
+  if (*parser->p != '\0' && *parser->p != '\n'
+      && *parser->p != ';' && *parser->p != '#')
+    goto unsupported;
+
+  result = assign_variable(parser, name, value.data);
+  goto out;
+
+unsupported:
+  unsupported(parser);
+  result = false;
+
+out:
+  free(value.data);
+  return result;
+}
+
+static bool parse_rcfile(struct parser *parser)
+{
+  while (*parser->p != '\0') {
+    switch (*parser->p) {
+      case '\n':
+        parser->line++;
+        /* fall through */
+      case ' ':
+      case '\t':
+      case ';':
+        parser->p++;
+        break;
+      case '#':
+        skip_line(parser);
+        break;
+      default:
+        errno = 0;
+        if (!parse_statement(parser))
+          return false;
+        break;
+    }
+  }
+
+  return true;
+}
+
+/* Read the whole file with the privileges of the real user.  Returns NULL and
+ * sets errno on error. */
+static char *read_file(const char *path)
+{
+  uid_t euid = geteuid();
+  char *data = NULL;
+  size_t length = 0;
+  int errsv = 0;
+  int fd;
+
+  /* vlock-main is most likely setuid root.  Do not let users read files they
+   * do not have access to. */
+  if (seteuid(getuid()) < 0)
+    return NULL;
+
+  fd = open(path, O_RDONLY | O_NOCTTY | O_CLOEXEC);
+
+  if (fd < 0) {
+    errsv = errno;
+    goto out;
+  }
+
+  data = malloc(RCFILE_MAX_SIZE + 1);
+
+  if (data == NULL) {
+    errsv = errno;
+    goto out;
+  }
+
+  for (;;) {
+    ssize_t n = read(fd, data + length, RCFILE_MAX_SIZE + 1 - length);
+
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+
+      errsv = errno;
+      break;
+    }
+
+    if (n == 0)
+      break;
+
+    length += n;
+
+    if (length > RCFILE_MAX_SIZE) {
+      errsv = EFBIG;
+      break;
+    }
+  }
+
+  if (errsv != 0) {
+    free(data);
+    data = NULL;
+  } else {
+    data[length] = '\0';
+  }
+
+out:
+  if (fd >= 0)
+    (void) close(fd);
+
+  if (seteuid(euid) < 0)
+    fatal_perror("vlock: could not restore privileges");
+
+  errno = errsv;
+  return data;
+}
+
+bool read_rcfile(const char *path)
+{
+  struct parser parser = {
+    .path = path,
+    .line = 1,
+    .variables = NULL,
+  };
+  char *data = read_file(path);
+  bool result;
+
+  if (data == NULL)
+    return errno == ENOENT;
+
+  parser.p = data;
+
+  result = parse_rcfile(&parser) && export_variables(&parser);
+
+  GUARD_ERRNO(free_variables(&parser));
+  GUARD_ERRNO(free(data));
+
+  return result;
+}
@@ -0,0 +1,30 @@
+/* rcfile.h -- header file for the ~/.vlockrc reader for vlock,
+ *             the VT locking program for linux
+ *
+ * This program is copyright (C) 2007 Frank Benkstein, and is free
+ * software which is freely distributable under the terms of the
+ * GNU General Public License version 2, included as the file COPYING in this
+ * distribution.  It is NOT public domain software, and any
+ * redistribution not permitted by the GNU General Public License is
+ * expressly forbidden without prior written permission from
+ * the author.
+ *
+ */
+
+#include <stdbool.h>
+
+/* Magic characters to clear the terminal. */
+#define CLEAR_SCREEN "\033[H\033[J"
+
+/* Enter message that is common to different the messages. */
+#define VLOCK_ENTER_PROMPT "Please press [ENTER] to unlock."
+
+/* Read the given configuration file and export every VLOCK_* variable that is
+ * assigned in it to the environment.  Only a subset of the shell syntax is
+ * understood: simple (optionally exported) assignments with single quoted,
+ * double quoted or unquoted values and $NAME or ${NAME} expansion.  If the
+ * file contains anything else this is reported, nothing is exported and false
+ * is returned with errno set to 0.  The file is opened with the privileges of
+ * the real user.  If the file does not exist true is returned.  On other
+ * errors false is returned and errno is set. */
+bool read_rcfile(const char *path);
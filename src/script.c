@@ -16,14 +16,17 @@
  * When dependencies are retrieved they are launched once for each dependency
  * and should print the names of the plugins they depend on on stdout one per
  * line.  The dependency requested is given as a single command line argument.
+ * Scripts that understand the protocol described at launch_protocol_script()
+ * are run only once to get all dependencies.  The results are cached (see
+ * script_cache.c) so this only happens again after the script was changed.
  *
  * In hook mode the script is called once with "hooks" as a single command line
  * argument.  It should not exit until its stdin closes.  The hook that should
  * be executed is written to its stdin on a single line.
  *
  * Currently there is no way for a script to communicate errors or even success
- * to vlock.  If it exits it will linger as a zombie until the plugin is
- * destroyed.
+ * to vlock.  If it exits it is reaped by the event loop and no more hooks are
+ * sent to it.
  */
 
 #if !defined(__FreeBSD__) && !defined(_GNU_SOURCE)
@@ -35,29 +38,39 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <limits.h>
-#include <sys/select.h>
 #include <fcntl.h>
 #include <signal.h>
 #include <errno.h>
-#include <sys/time.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
 #include <time.h>
 
+#include "event.h"
 #include "list.h"
 #include "process.h"
 #include "util.h"
 
 #include "plugin.h"
+#include "script_cache.h"
 
 static bool init_script(struct plugin *p);
 static void destroy_script(struct plugin *p);
-static bool call_script_hook(struct plugin *p, const char *hook_name);
+static bool call_script_hook(struct plugin *p, size_t hook);
+static bool check_script(struct plugin *p);
+static struct plugin *finish_scripts(struct list *plugins);
 
 struct plugin_type *script = &(struct plugin_type){
   .init = init_script,
   .destroy = destroy_script,
   .call_hook = call_script_hook,
+  .check = check_script,
+  .finish = finish_scripts,
 };
 
+/* Time a script has to exit after its stdin was closed before it is
+ * killed. */
+static const struct timespec exit_timeout = { 0, 500000000L };
+
 struct script_context 
 {
   /* The path to the script. */
@@ -68,15 +81,31 @@ struct script_context
   bool dead;
   /* The pipe file descriptor that is connected to the script's stdin. */
   int fd;
-  /* The PID of the script. */
+  /* The PID of the script.  0 after it was reaped. */
   pid_t pid;
+  /* Watches the death of the script. */
+  struct event_source *child_source;
+  /* Is the protocol header still to be read? */
+  bool pending;
+  /* The pipe file descriptor that is connected to the script's stdout while
+   * the header is read. */
+  int header_fd;
+  /* Reads the header while finish_scripts() runs. */
+  struct event_source *header_source;
+  /* The header data read so far. */
+  char *header;
+  size_t header_length;
+  /* Was the whole header read? */
+  bool header_done;
+  /* The status of the script before it was run. */
+  struct stat status;
+  bool have_status;
 };
 
-/* Get the dependency from the script. */ 
-static bool get_dependency(const char *path, const char *dependency_name,
-    struct list *dependency_list);
 /* Launch the script creating a new script_context. */
 static bool launch_script(struct script_context *script);
+/* Launch the script using the single exec protocol. */
+static bool launch_protocol_script(struct script_context *script);
 
 bool init_script(struct plugin *p)
 {
@@ -88,6 +117,12 @@ bool init_script(struct plugin *p)
 
   context->dead = false;
   context->launched = false;
+  context->pending = false;
+  context->child_source = NULL;
+  context->header_source = NULL;
+  context->header = NULL;
+  context->header_length = 0;
+  context->header_done = false;
 
   if (asprintf(&context->path, "%s/%s", VLOCK_SCRIPT_DIR, p->name) < 0) {
     free(context);
@@ -95,12 +130,24 @@ bool init_script(struct plugin *p)
     return false;
   }
 
-  /* Get the dependency information.  Whether the script is executable or not
-   * is also detected here. */
-  for (size_t i = 0; i < nr_dependencies; i++)
-    if (!get_dependency(context->path, dependency_names[i], p->dependencies[i]))
+  context->have_status = (stat(context->path, &context->status) == 0);
+
+  if (context->have_status
+      && script_cache_lookup(context->path, &context->status, p->dependencies)) {
+    /* The script is not run here so check manually whether the user may
+     * execute it. */
+    if (access(context->path, X_OK) < 0)
       goto error;
+  } else if (context->have_status && errno != 0) {
+    goto error;
+  } else if (!launch_protocol_script(context)) {
+    /* Whether the script is executable or not is detected here. */
+    goto error;
+  }
 
+  /* The dependencies of a launched script are read by finish_scripts()
+   * together with those of all other scripts that are loaded at the same
+   * time. */
   p->context = context;
   return true;
 
@@ -112,6 +159,14 @@ error:
   return false;
 }
 
+/* Check that the real user may execute the script. */
+static bool check_script(struct plugin *p)
+{
+  struct script_context *context = p->context;
+
+  return access(context->path, X_OK) == 0;
+}
+
 static void destroy_script(struct plugin *p)
 {
   struct script_context *context = p->context;
@@ -119,12 +174,19 @@ static void destroy_script(struct plugin *p)
   if (context != NULL) {
     free(context->path);
 
+    if (context->pending) {
+      (void) close(context->header_fd);
+      free(context->header);
+    }
+
     if (context->launched) {
+      event_remove(context->child_source);
+
       /* Close the pipe. */
       (void) close(context->fd);
 
       /* Kill the child process. */
-      if (!wait_for_death(context->pid, 0, 500000L))
+      if (!wait_for_death(context->pid, &exit_timeout))
         ensure_death(context->pid);
     }
 
@@ -133,10 +195,11 @@ static void destroy_script(struct plugin *p)
 }
 
 /* Invoke the hook by writing it on a single line to the scripts stdin. */
-static bool call_script_hook(struct plugin *s, const char *hook_name)
+static bool call_script_hook(struct plugin *s, size_t hook)
 {
   static const char newline = '\n';
   struct script_context *context = s->context;
+  const char *hook_name = hooks[hook].name;
   ssize_t hook_name_length = strlen(hook_name);
   ssize_t length;
   struct sigaction act;
@@ -176,6 +239,27 @@ static bool call_script_hook(struct plugin *s, const char *hook_name)
   return !context->dead;
 }
 
+/* Reap the script as soon as it exits. */
+static void script_died(void *data)
+{
+  struct script_context *script = data;
+
+  if (waitpid(script->pid, NULL, WNOHANG) == script->pid)
+    script->pid = 0;
+
+  script->dead = true;
+  event_remove(script->child_source);
+  script->child_source = NULL;
+}
+
+/* Start watching the launched script.  Without process file descriptors its
+ * death is only noticed when writing to it fails. */
+static void watch_script(struct script_context *script)
+{
+  script->dead = false;
+  script->child_source = event_watch_child(script->pid, script_died, script);
+}
+
 static bool launch_script(struct script_context *script)
 {
   int fd_flags;
@@ -194,6 +278,7 @@ static bool launch_script(struct script_context *script)
 
   script->fd = child.stdin_fd;
   script->pid = child.pid;
+  watch_script(script);
 
   fd_flags = fcntl(script->fd, F_GETFL, &fd_flags);
 
@@ -205,34 +290,272 @@ static bool launch_script(struct script_context *script)
   return true;
 }
 
-static char *read_dependency(const char *path, const char *dependency_name);
+static bool parse_header(char *data, struct list **dependencies);
 static bool parse_dependency(char *data, struct list *dependency_list);
+static ssize_t read_more(int fd, char **data, size_t *data_length,
+    size_t max_length);
+
+/* The script is run with "vlock-protocol-2" as the single command line
+ * argument.  If it understands this it prints "VLOCK-PROTOCOL 2", one line per
+ * dependency consisting of the dependency name followed by the dependencies
+ * and finally a line containing just "END".  After that it behaves exactly as
+ * if run with "hooks", but its stdin is closed as soon as the header was read.
+ * This saves running the script once per dependency.  Scripts that do not
+ * understand the command usually exit with an error message. */
+#define PROTOCOL_COMMAND "vlock-protocol-2"
+#define PROTOCOL_HEADER "VLOCK-PROTOCOL 2\n"
+#define PROTOCOL_END "\nEND\n"
+#define PROTOCOL_HEADER_MAX (nr_dependencies * LINE_MAX)
+
+/* Launch the script using the protocol described above.  The header is read
+ * later. */
+static bool launch_protocol_script(struct script_context *script)
+{
+  const char *argv[] = { script->path, PROTOCOL_COMMAND, NULL };
+  struct child_process child = {
+    .path = script->path,
+    .argv = argv,
+    .stdin_fd = REDIRECT_PIPE,
+    .stdout_fd = REDIRECT_PIPE,
+    .stderr_fd = REDIRECT_DEV_NULL,
+    .function = NULL,
+  };
+
+  if (!create_child(&child))
+    return false;
 
-/* Get the dependency from the script. */
-static bool get_dependency(const char *path, const char *dependency_name,
-    struct list *dependency_list)
+  script->fd = child.stdin_fd;
+  script->pid = child.pid;
+  script->header_fd = child.stdout_fd;
+  script->launched = true;
+  script->pending = true;
+  watch_script(script);
+
+  return true;
+}
+
+static struct script_context *get_pending_context(struct plugin *p)
 {
-  /* Read the dependency data. */
-  char *data;
-  errno = 0;
-  data = read_dependency(path, dependency_name);
+  struct script_context *context = p->context;
+
+  if (p->type != script || !context->pending)
+    return NULL;
 
-  if (data == NULL)  {
-    return errno == 0;
+  return context;
+}
+
+/* Number of headers that are still being read by read_headers(). */
+static size_t nr_reading_headers;
+/* Set when all headers were read or the timeout occurred. */
+static bool reading_headers_done;
+
+static void stop_reading_header(struct script_context *context)
+{
+  event_remove(context->header_source);
+  context->header_source = NULL;
+  context->header_done = true;
+
+  reading_headers_done = (--nr_reading_headers == 0);
+}
+
+static void read_header(void *data)
+{
+  struct script_context *context = data;
+
+  if (read_more(context->header_fd, &context->header,
+        &context->header_length, PROTOCOL_HEADER_MAX) <= 0
+      || strstr(context->header, PROTOCOL_END) != NULL)
+    stop_reading_header(context);
+}
+
+static void header_timeout(void __attribute__((unused)) *data)
+{
+  reading_headers_done = true;
+}
+
+/* Read the protocol headers of all pending scripts at once.  Reading stops for
+ * a script when the end of its header was read, it closed its stdout or its
+ * header is too long.  Reading stops altogether after one second. */
+static void read_headers(struct list *plugins)
+{
+  static const struct timespec timeout = { 1, 0 };
+  struct event_source *timer;
+
+  nr_reading_headers = 0;
+
+  list_for_each(plugins, plugin_item) {
+    struct script_context *context = get_pending_context(plugin_item->data);
+
+    if (context == NULL || context->header_done)
+      continue;
+
+    context->header_source = event_watch_fd(context->header_fd, read_header,
+        context);
+
+    if (context->header_source != NULL)
+      nr_reading_headers++;
+    else
+      context->header_done = true;
+  }
+
+  if (nr_reading_headers == 0)
+    return;
+
+  reading_headers_done = false;
+  timer = event_add_timer(&timeout, header_timeout, NULL);
+
+  if (timer != NULL)
+    (void) event_loop(&reading_headers_done);
+
+  event_remove(timer);
+
+  list_for_each(plugins, plugin_item) {
+    struct script_context *context = get_pending_context(plugin_item->data);
+
+    if (context != NULL && context->header_source != NULL)
+      stop_reading_header(context);
+  }
+}
+
+/* Get the dependencies of a script from the header it printed.  Afterwards
+ * its stdin is closed so that it exits.  It is reaped by finish_scripts().  If
+ * the script does not understand the protocol false is returned and errno is
+ * set to 0, or to the error that occured while parsing the header. */
+static bool finish_script(struct plugin *p)
+{
+  struct script_context *context = p->context;
+  bool result;
+  int errsv = 0;
+
+  if (context->header != NULL) {
+    result = parse_header(context->header, p->dependencies);
+    errsv = errno;
   } else {
-    /* Parse the dependency data. */
-    bool result = parse_dependency(data, dependency_list);
+    result = false;
+  }
+
+  /* Anything the script prints after the header is ignored. */
+  (void) close(context->header_fd);
+  free(context->header);
+  context->header = NULL;
+  context->pending = false;
+
+  /* Stop the script.  The hooks are run by a new process that is launched
+   * when the first hook is called.  Plugins may be loaded by the lock service
+   * which then forks a child for every client, see service.c.  This way the
+   * hooks run in the child with the privileges of the client and every child
+   * has its own process. */
+  event_remove(context->child_source);
+  context->child_source = NULL;
+  (void) close(context->fd);
+  context->launched = false;
+
+  if (result && context->have_status)
+    script_cache_store(context->path, &context->status, p->dependencies);
+
+  errno = errsv;
+  return result;
+}
+
+/* State of reading the output of a script with the old protocol. */
+struct output_reader
+{
+  int fd;
+  char *data;
+  size_t data_length;
+  /* Watches the fd while reading. */
+  struct event_source *source;
+  /* The error that stopped reading or 0 on end-of-file. */
+  int error;
+};
+
+/* Number of outputs that are still being read by read_outputs(). */
+static size_t nr_reading_outputs;
+/* Set when all outputs were read or the timeout occurred. */
+static bool reading_outputs_done;
+
+static void stop_reading_output(struct output_reader *reader)
+{
+  event_remove(reader->source);
+  reader->source = NULL;
+
+  reading_outputs_done = (--nr_reading_outputs == 0);
+}
+
+static void read_output_data(void *data)
+{
+  struct output_reader *reader = data;
+  ssize_t length = read_more(reader->fd, &reader->data, &reader->data_length,
+      LINE_MAX);
+
+  if (length < 0)
+    reader->error = errno;
+
+  /* Did the script close its stdout or exit? */
+  if (length <= 0)
+    stop_reading_output(reader);
+}
+
+static void read_outputs_timeout(void __attribute__((unused)) *data)
+{
+  reading_outputs_done = true;
+}
+
+/* Read the outputs of scripts at once until end-of-file.  Reading fails for a
+ * script if it prints more than LINE_MAX bytes or does not close its stdout
+ * before the timeout of one second elapses. */
+static void read_outputs(struct output_reader *readers, size_t nr_readers)
+{
+  static const struct timespec timeout = { 1, 0 };
+  struct event_source *timer;
+
+  nr_reading_outputs = 0;
+
+  for (size_t i = 0; i < nr_readers; i++) {
+    if (readers[i].error != 0)
+      continue;
+
+    readers[i].source = event_watch_fd(readers[i].fd, read_output_data,
+        &readers[i]);
+
+    if (readers[i].source != NULL)
+      nr_reading_outputs++;
+    else
+      readers[i].error = errno;
+  }
+
+  if (nr_reading_outputs == 0)
+    return;
+
+  reading_outputs_done = false;
+  timer = event_add_timer(&timeout, read_outputs_timeout, NULL);
+
+  if (timer == NULL || !event_loop(&reading_outputs_done)) {
     int errsv = errno;
-    free(data);
-    errno = errsv;
-    return result;
+
+    for (size_t i = 0; i < nr_readers; i++)
+      if (readers[i].source != NULL)
+        readers[i].error = errsv;
   }
+
+  event_remove(timer);
+
+  for (size_t i = 0; i < nr_readers; i++)
+    if (readers[i].source != NULL) {
+      if (readers[i].error == 0)
+        readers[i].error = ETIMEDOUT;
+
+      stop_reading_output(&readers[i]);
+    }
 }
 
-/* Read the dependency data by starting the script with the name of the
- * dependency as a single command line argument.  The script should then print
- * the dependencies to its stdout one on per line. */
-static char *read_dependency(const char *path, const char *dependency_name)
+/* Start the script with the name of the dependency as a single command line
+ * argument.  The script should then print the dependencies to its stdout one
+ * per line.  Returns the PID of the script and stores the read end of its
+ * stdout in the reader.  On error 0 is returned and the error is stored in the
+ * reader. */
+static pid_t launch_dependency_script(const char *path,
+    const char *dependency_name, struct output_reader *reader)
 {
   const char *argv[] = { path, dependency_name, NULL };
   struct child_process child = {
@@ -243,100 +566,163 @@ static char *read_dependency(const char *path, const char *dependency_name)
     .stderr_fd = REDIRECT_DEV_NULL,
     .function = NULL,
   };
-  struct timeval timeout = {1, 0};
-  char *data = calloc(1, sizeof *data);
-  size_t data_length = 0;
-
-  if (data == NULL)
-    return NULL;
 
   if (!create_child(&child)) {
-    int errsv = errno;
-    free(data);
-    errno = errsv;
-    return NULL;
+    reader->error = errno;
+    return 0;
   }
 
-  /* Read the dependency from the child.  Reading fails if either the timeout
-   * elapses or more that LINE_MAX bytes are read. */
-  for (;;) {
-    struct timeval t = timeout;
-    struct timeval t1;
-    struct timeval t2;
-    char buffer[LINE_MAX];
-    ssize_t length;
+  reader->fd = child.stdout_fd;
 
-    fd_set read_fds;
+  return child.pid;
+}
 
-    FD_ZERO(&read_fds);
-    FD_SET(child.stdout_fd, &read_fds);
+/* Read the dependencies of the scripts that only understand the old protocol.
+ * Every script is run once per dependency and all of them run at the same
+ * time.  Returns the first script that failed with errno set or NULL on
+ * success. */
+static struct plugin *finish_old_scripts(struct plugin **scripts,
+    size_t nr_scripts)
+{
+  size_t nr_readers = nr_scripts * nr_dependencies;
+  struct output_reader readers[nr_readers > 0 ? nr_readers : 1];
+  pid_t pids[nr_readers > 0 ? nr_readers : 1];
+  struct plugin *failed = NULL;
+
+  for (size_t i = 0; i < nr_readers; i++) {
+    struct script_context *context = scripts[i / nr_dependencies]->context;
+
+    readers[i].fd = -1;
+    readers[i].data = NULL;
+    readers[i].data_length = 0;
+    readers[i].source = NULL;
+    readers[i].error = 0;
+
+    pids[i] = launch_dependency_script(context->path,
+        dependency_names[i % nr_dependencies], &readers[i]);
+  }
 
-    /* t1 is before select. */
-    (void) gettimeofday(&t1, NULL);
+  read_outputs(readers, nr_readers);
 
-    if (select(child.stdout_fd+1, &read_fds, NULL, NULL, &t) != 1) {
-timeout:
-      errno = ETIMEDOUT;
-      goto error;
+  /* Close the read ends of the pipes and kill the scripts.  All of them get the
+   * same 500ms to exit. */
+  for (size_t i = 0; i < nr_readers; i++)
+    if (readers[i].fd >= 0)
+      (void) close(readers[i].fd);
+
+  if (!wait_for_children(pids, nr_readers, &exit_timeout))
+    ensure_children_death(pids, nr_readers);
+
+  for (size_t i = 0; i < nr_scripts && failed == NULL; i++) {
+    struct plugin *p = scripts[i];
+    struct script_context *context = p->context;
+
+    for (size_t j = 0; j < nr_dependencies && failed == NULL; j++) {
+      struct output_reader *reader = &readers[i * nr_dependencies + j];
+
+      if (reader->error != 0) {
+        errno = reader->error;
+        failed = p;
+      } else if (reader->data != NULL
+          && !parse_dependency(reader->data, p->dependencies[j])) {
+        failed = p;
+      }
     }
 
-    /* t2 is after select. */
-    (void) gettimeofday(&t2, NULL);
+    if (failed == NULL && context->have_status)
+      script_cache_store(context->path, &context->status, p->dependencies);
+  }
 
-    /* Get the time that during select. */
-    timersub(&t2, &t1, &t2);
+  for (size_t i = 0; i < nr_readers; i++)
+    free(readers[i].data);
 
-    /* This is very unlikely. */
-    if (timercmp(&t2, &timeout, >))
-      goto timeout;
+  return failed;
+}
 
-    /* Reduce the timeout. */
-    timersub(&timeout, &t2, &timeout);
+static size_t count_pending(struct list *plugins)
+{
+  size_t nr_pending = 0;
 
-    /* Read dependency data from the script. */
-    length = read(child.stdout_fd, buffer, sizeof buffer - 1);
+  list_for_each(plugins, plugin_item)
+    if (get_pending_context(plugin_item->data) != NULL)
+      nr_pending++;
 
-    /* Did the script close its stdin or exit? */
-    if (length <= 0)
-      break;
+  return nr_pending;
+}
 
-    if (data_length+length+1 > LINE_MAX) {
-      errno = EFBIG;
-      goto error;
-    }
+static struct plugin *finish_scripts(struct list *plugins)
+{
+  size_t nr_pending = count_pending(plugins);
+  size_t nr_stopped = 0;
+  size_t nr_failed = 0;
+  struct plugin *failed[nr_pending > 0 ? nr_pending : 1];
+  pid_t pids[nr_pending > 0 ? nr_pending : 1];
+  int errors[nr_pending > 0 ? nr_pending : 1];
 
-    /* Grow the data string. */
-    data = realloc(data, data_length+length);
+  read_headers(plugins);
 
-    if (data == NULL)
-      goto error;
+  list_for_each(plugins, plugin_item) {
+    struct plugin *p = plugin_item->data;
+    struct script_context *context = get_pending_context(p);
+
+    if (context == NULL)
+      continue;
 
-    /* Append the buffer to the data string. */
-    strncpy(data+data_length, buffer, length);
-    data_length += length;
+    pids[nr_stopped++] = context->pid;
+
+    if (!finish_script(p)) {
+      failed[nr_failed] = p;
+      errors[nr_failed] = errno;
+      nr_failed++;
+    }
   }
 
-  /* Terminate the data string. */
-  data[data_length] = '\0';
+  /* All stopped scripts get the same 500ms to exit. */
+  if (!wait_for_children(pids, nr_stopped, &exit_timeout))
+    ensure_children_death(pids, nr_stopped);
 
-  /* Close the read end of the pipe. */
-  (void) close(child.stdout_fd);
-  /* Kill the script. */
-  if (!wait_for_death(child.pid, 0, 500000L))
-    ensure_death(child.pid);
+  for (size_t i = 0; i < nr_failed; i++)
+    if (errors[i] != 0) {
+      errno = errors[i];
+      return failed[i];
+    }
 
-  return data;
+  /* The remaining scripts only understand the old protocol. */
+  return finish_old_scripts(failed, nr_failed);
+}
 
-error:
-  {
-    int errsv = errno;
-    free(data);
-    (void) close(child.stdout_fd);
-    if (!wait_for_death(child.pid, 0, 500000L))
-      ensure_death(child.pid);
-    errno = errsv;
-    return NULL;
+/* Read once from the given file descriptor and append the data to the string
+ * *data of length *data_length.  Returns the number of bytes read, 0 on
+ * end-of-file or -1 on error.  Fails if the string would get longer than
+ * max_length bytes. */
+static ssize_t read_more(int fd, char **data, size_t *data_length,
+    size_t max_length)
+{
+  char buffer[LINE_MAX];
+  ssize_t length = read(fd, buffer, sizeof buffer);
+  char *new_data;
+
+  if (length <= 0)
+    return length;
+
+  if (*data_length+length+1 > max_length) {
+    errno = EFBIG;
+    return -1;
   }
+
+  /* Grow the data string. */
+  new_data = realloc(*data, *data_length+length+1);
+
+  if (new_data == NULL)
+    return -1;
+
+  /* Append the buffer to the data string. */
+  memcpy(new_data+*data_length, buffer, length);
+  *data_length += length;
+  new_data[*data_length] = '\0';
+  *data = new_data;
+
+  return length;
 }
 
 static bool parse_dependency(char *data, struct list *dependency_list)
@@ -352,3 +738,36 @@ static bool parse_dependency(char *data, struct list *dependency_list)
 
   return true;
 }
+
+/* Parse the dependencies from a protocol header.  Returns false with errno set
+ * to 0 if the data is not a valid header. */
+static bool parse_header(char *data, struct list **dependencies)
+{
+  char *end = strstr(data, PROTOCOL_END);
+
+  if (end == NULL || strncmp(data, PROTOCOL_HEADER, strlen(PROTOCOL_HEADER)) != 0) {
+    errno = 0;
+    return false;
+  }
+
+  /* Cut off the end marker and everything after it. */
+  end[1] = '\0';
+
+  for (char *saveptr, *line = strtok_r(data + strlen(PROTOCOL_HEADER), "\n", &saveptr);
+      line != NULL;
+      line = strtok_r(NULL, "\n", &saveptr)) {
+    size_t name_length = strcspn(line, " \r");
+
+    /* Unknown dependencies are ignored. */
+    for (size_t i = 0; i < nr_dependencies; i++)
+      if (strlen(dependency_names[i]) == name_length
+          && strncmp(line, dependency_names[i], name_length) == 0) {
+        if (!parse_dependency(line + name_length, dependencies[i]))
+          return false;
+
+        break;
+      }
+  }
+
+  return true;
+}
@@ -0,0 +1,320 @@
+/* script_cache.c -- script dependency cache for vlock,
+ *                   the VT locking program for linux
+ *
+ * This program is copyright (C) 2007 Frank Benkstein, and is free
+ * software which is freely distributable under the terms of the
+ * GNU General Public License version 2, included as the file COPYING in this
+ * distribution.  It is NOT public domain software, and any
+ * redistribution not permitted by the GNU General Public License is
+ * expressly forbidden without prior written permission from
+ * the author.
+ *
+ */
+
+/* Reading the dependencies of a script means running it once per dependency
+ * type.  The results are kept in a cache file so that unchanged scripts are
+ * not run again.  The file has one line per script:
+ *
+ *   path TAB device TAB inode TAB size TAB mtime TAB mtime-nsec
+ *        TAB succeeds TAB preceeds TAB requires TAB needs TAB depends
+ *        TAB conflicts NEWLINE
+ *
+ * where each dependency field is a space separated list of plugin names.  An
+ * entry is only valid if the status of the script still matches.  The file is
+ * only trusted if it is owned by root and not writable by anybody else.  It is
+ * only written if vlock-main runs with root privileges. */
+
+#if !defined(__FreeBSD__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "list.h"
+#include "util.h"
+
+#include "plugin.h"
+#include "script_cache.h"
+
+#define CACHE_FILE VLOCK_CACHE_DIR "/scripts"
+
+/* Get the key of the cache entry, i.e. the beginning of the line up to and
+ * including the tab before the first dependency field.  Paths containing tabs
+ * or newlines cannot be cached and NULL is returned with errno set to 0. */
+static char *get_key(const char *path, const struct stat *st)
+{
+  char *key;
+
+  if (strpbrk(path, "\t\n") != NULL) {
+    errno = 0;
+    return NULL;
+  }
+
+  if (asprintf(&key, "%s\t%ju\t%ju\t%jd\t%jd\t%ld\t",
+        path,
+        (uintmax_t) st->st_dev,
+        (uintmax_t) st->st_ino,
+        (intmax_t) st->st_size,
+        (intmax_t) st->st_mtim.tv_sec,
+        (long) st->st_mtim.tv_nsec) < 0) {
+    errno = ENOMEM;
+    return NULL;
+  }
+
+  return key;
+}
+
+/* Open the cache file for reading if it can be trusted. */
+static FILE *open_cache(void)
+{
+  struct stat st;
+  FILE *f;
+  int fd = open(CACHE_FILE, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+
+  if (fd < 0)
+    return NULL;
+
+  if (fstat(fd, &st) < 0
+      || !S_ISREG(st.st_mode)
+      || st.st_uid != 0
+      || (st.st_mode & (S_IWGRP | S_IWOTH)) != 0) {
+    (void) close(fd);
+    return NULL;
+  }
+
+  f = fdopen(fd, "r");
+
+  if (f == NULL)
+    (void) close(fd);
+
+  return f;
+}
+
+/* Remove the dependencies that were appended after the given last items. */
+static void drop_dependencies(struct list **dependencies,
+    struct list_item **last)
+{
+  for (size_t i = 0; i < nr_dependencies; i++) {
+    struct list_item *item =
+      last[i] != NULL ? last[i]->next : dependencies[i]->first;
+
+    while (item != NULL) {
+      free(item->data);
+      item = list_delete_item(dependencies[i], item);
+    }
+  }
+}
+
+/* Parse the dependency fields of an entry.  Returns false with errno set to 0
+ * if the entry is malformed.  Nothing is appended to the dependencies then. */
+static bool parse_entry(char *fields, struct list **dependencies)
+{
+  struct list_item *last[nr_dependencies];
+  size_t length = strlen(fields);
+  size_t nr_tabs = 0;
+  char *field = fields;
+
+  /* A line without newline was truncated. */
+  if (length == 0 || fields[length-1] != '\n') {
+    errno = 0;
+    return false;
+  }
+
+  fields[length-1] = '\0';
+
+  for (char *s = fields; *s != '\0'; s++)
+    if (*s == '\t')
+      nr_tabs++;
+
+  if (nr_tabs != nr_dependencies - 1) {
+    errno = 0;
+    return false;
+  }
+
+  for (size_t i = 0; i < nr_dependencies; i++)
+    last[i] = dependencies[i]->last;
+
+  for (size_t i = 0; i < nr_dependencies; i++) {
+    char *next = strchr(field, '\t');
+
+    if (next != NULL)
+      *next++ = '\0';
+
+    for (char *saveptr, *token = strtok_r(field, " ", &saveptr);
+        token != NULL;
+        token = strtok_r(NULL, " ", &saveptr)) {
+      char *s = strdup(token);
+
+      if (s == NULL || !list_append(dependencies[i], s)) {
+        free(s);
+        drop_dependencies(dependencies, last);
+        errno = ENOMEM;
+        return false;
+      }
+    }
+
+    field = next;
+  }
+
+  return true;
+}
+
+bool script_cache_lookup(const char *path, const struct stat *st,
+    struct list **dependencies)
+{
+  char *key = get_key(path, st);
+  char *line = NULL;
+  size_t line_size = 0;
+  bool found = false;
+  int errsv = 0;
+  FILE *f;
+
+  if (key == NULL)
+    return false;
+
+  f = open_cache();
+
+  if (f != NULL) {
+    size_t key_length = strlen(key);
+
+    while (getline(&line, &line_size, f) > 0)
+      if (strncmp(line, key, key_length) == 0) {
+        found = parse_entry(line + key_length, dependencies);
+
+        if (!found)
+          errsv = errno;
+
+        break;
+      }
+
+    (void) fclose(f);
+  }
+
+  free(line);
+  free(key);
+
+  errno = errsv;
+  return found;
+}
+
+/* Should the given line of the old cache file be copied to the new one?
+ * Entries for the same path and for scripts that no longer exist are
+ * dropped. */
+static bool keep_entry(const char *line, const char *path)
+{
+  const char *tab = strchr(line, '\t');
+  char *entry_path;
+  bool result;
+
+  if (tab == NULL || line[strlen(line)-1] != '\n')
+    return false;
+
+  entry_path = strndup(line, tab - line);
+
+  if (entry_path == NULL)
+    return false;
+
+  result = strcmp(entry_path, path) != 0 && access(entry_path, F_OK) == 0;
+
+  free(entry_path);
+
+  return result;
+}
+
+static void write_entry(FILE *f, const char *key, struct list **dependencies)
+{
+  fputs(key, f);
+
+  for (size_t i = 0; i < nr_dependencies; i++) {
+    const char *separator = "";
+
+    if (i > 0)
+      fputc('\t', f);
+
+    list_for_each(dependencies[i], dependency_item) {
+      fprintf(f, "%s%s", separator, (const char *) dependency_item->data);
+      separator = " ";
+    }
+  }
+
+  fputc('\n', f);
+}
+
+void script_cache_store(const char *path, const struct stat *st,
+    struct list **dependencies)
+{
+  char *key;
+  char *tmp_path;
+  FILE *old_cache;
+  FILE *new_cache;
+  int fd;
+
+  /* Nobody else may write the cache. */
+  if (geteuid() != 0)
+    return;
+
+  /* Dependencies containing separators cannot be stored. */
+  for (size_t i = 0; i < nr_dependencies; i++)
+    list_for_each(dependencies[i], dependency_item)
+      if (strpbrk(dependency_item->data, "\t\n ") != NULL)
+        return;
+
+  key = get_key(path, st);
+
+  if (key == NULL)
+    return;
+
+  if (asprintf(&tmp_path, "%s.XXXXXX", CACHE_FILE) < 0) {
+    free(key);
+    return;
+  }
+
+  fd = mkostemp(tmp_path, O_CLOEXEC);
+
+  if (fd < 0)
+    goto out;
+
+  (void) fchmod(fd, 0644);
+
+  new_cache = fdopen(fd, "w");
+
+  if (new_cache == NULL) {
+    (void) close(fd);
+    (void) unlink(tmp_path);
+    goto out;
+  }
+
+  old_cache = open_cache();
+
+  if (old_cache != NULL) {
+    char *line = NULL;
+    size_t line_size = 0;
+
+    while (getline(&line, &line_size, old_cache) > 0)
+      if (keep_entry(line, path))
+        fputs(line, new_cache);
+
+    free(line);
+    (void) fclose(old_cache);
+  }
+
+  write_entry(new_cache, key, dependencies);
+
+  /* Replace the cache atomically. */
+  if (ferror(new_cache) | (fclose(new_cache) != 0)
+      || rename(tmp_path, CACHE_FILE) < 0)
+    (void) unlink(tmp_path);
+
+out:
+  free(tmp_path);
+  free(key);
+}
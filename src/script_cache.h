@@ -0,0 +1,33 @@
+/* script_cache.h -- header file for the script dependency cache of vlock,
+ *                   the VT locking program for linux
+ *
+ * This program is copyright (C) 2007 Frank Benkstein, and is free
+ * software which is freely distributable under the terms of the
+ * GNU General Public License version 2, included as the file COPYING in this
+ * distribution.  It is NOT public domain software, and any
+ * redistribution not permitted by the GNU General Public License is
+ * expressly forbidden without prior written permission from
+ * the author.
+ *
+ */
+
+#include <stdbool.h>
+
+#include <sys/stat.h>
+
+struct list;
+
+/* Look up the cached dependencies of the script at the given path.  The
+ * status of the script must be given to detect if it changed.  If a valid
+ * entry is found the dependencies are appended to the given array of
+ * nr_dependencies lists and true is returned.  Otherwise nothing is appended,
+ * false is returned and errno is set to 0 or, if the entry could not be
+ * copied, to an error code. */
+bool script_cache_lookup(const char *path, const struct stat *st,
+    struct list **dependencies);
+
+/* Store the dependencies of the script at the given path in the cache.  The
+ * status of the script must be the one that was taken before the
+ * dependencies were read.  Errors are silently ignored. */
+void script_cache_store(const char *path, const struct stat *st,
+    struct list **dependencies);
@@ -0,0 +1,283 @@
+/* service.c -- lock service for vlock, the VT locking program for linux
+ *
+ * This program is copyright (C) 2007 Frank Benkstein, and is free
+ * software which is freely distributable under the terms of the
+ * GNU General Public License version 2, included as the file COPYING in this
+ * distribution.  It is NOT public domain software, and any
+ * redistribution not permitted by the GNU General Public License is
+ * expressly forbidden without prior written permission from
+ * the author.
+ *
+ */
+
+/* In service mode vlock-main is started once by root.  It loads and sorts
+ * all plugins and then waits for clients on a unix domain socket.  A client
+ * connects, sends the file descriptor of its terminal and waits.  For every
+ * client the service forks.  The child takes over the client's identity and
+ * locks the terminal just like a freshly started vlock-main would.  After
+ * successful authentication a single zero byte is sent to the client.  If the
+ * connection is closed without it locking failed.
+ *
+ * The expensive setup (loading modules, running scripts to get their
+ * dependencies, sorting) is thus done only once. */
+
+#if !defined(__FreeBSD__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <errno.h>
+#include <pwd.h>
+#include <grp.h>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+
+#include "event.h"
+#include "service.h"
+#include "util.h"
+
+/* How long a client may take to send its terminal. */
+#define REQUEST_TIMEOUT_SECONDS 5
+
+/* The connection to the client in the child process. */
+static int client_fd = -1;
+
+static int create_socket(const char *socket_path)
+{
+  struct sockaddr_un addr;
+  mode_t old_umask;
+  int fd;
+
+  memset(&addr, 0, sizeof addr);
+  addr.sun_family = AF_UNIX;
+
+  if (strlen(socket_path) >= sizeof addr.sun_path) {
+    errno = ENAMETOOLONG;
+    return -1;
+  }
+
+  strcpy(addr.sun_path, socket_path);
+
+  fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+
+  if (fd < 0)
+    return -1;
+
+  /* Remove the socket of a previous instance. */
+  (void) unlink(socket_path);
+
+  /* Every user may connect. */
+  old_umask = umask(0111);
+
+  if (bind(fd, (struct sockaddr *) &addr, sizeof addr) < 0
+      || listen(fd, SOMAXCONN) < 0) {
+    int errsv = errno;
+    (void) umask(old_umask);
+    (void) close(fd);
+    errno = errsv;
+    return -1;
+  }
+
+  (void) umask(old_umask);
+
+  return fd;
+}
+
+/* Receive the terminal file descriptor from the client.  Returns -1 on
+ * error. */
+static int receive_terminal(int fd)
+{
+  char data;
+  struct iovec iov = { .iov_base = &data, .iov_len = sizeof data };
+  union {
+    struct cmsghdr header;
+    char buffer[CMSG_SPACE(sizeof (int))];
+  } control;
+  struct msghdr msg = {
+    .msg_iov = &iov,
+    .msg_iovlen = 1,
+    .msg_control = control.buffer,
+    .msg_controllen = sizeof control.buffer,
+  };
+  struct cmsghdr *cmsg;
+  int terminal_fd;
+
+  if (recvmsg(fd, &msg, MSG_CMSG_CLOEXEC) != sizeof data)
+    return -1;
+
+  cmsg = CMSG_FIRSTHDR(&msg);
+
+  if (cmsg == NULL
+      || cmsg->cmsg_level != SOL_SOCKET
+      || cmsg->cmsg_type != SCM_RIGHTS
+      || cmsg->cmsg_len != CMSG_LEN(sizeof (int))) {
+    errno = EPROTO;
+    return -1;
+  }
+
+  memcpy(&terminal_fd, CMSG_DATA(cmsg), sizeof terminal_fd);
+
+  return terminal_fd;
+}
+
+/* Get the real user and group IDs of the client. */
+static bool get_client_ids(int fd, uid_t *uid, gid_t *gid)
+{
+#ifdef SO_PEERCRED
+  struct ucred cred;
+  socklen_t length = sizeof cred;
+
+  if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &length) < 0)
+    return false;
+
+  *uid = cred.uid;
+  *gid = cred.gid;
+
+  return true;
+#else
+  return getpeereid(fd, uid, gid) == 0;
+#endif
+}
+
+/* Set up the child process for the given client.  Returns the name of the
+ * client's user. */
+static char *serve_client(int fd)
+{
+  struct timeval timeout = { REQUEST_TIMEOUT_SECONDS, 0 };
+  struct sigaction sa;
+  struct passwd *pw;
+  char *username;
+  int terminal_fd;
+  uid_t uid;
+  gid_t gid;
+
+  /* Children of this process must be waited for again. */
+  (void) sigemptyset(&(sa.sa_mask));
+  sa.sa_flags = 0;
+  sa.sa_handler = SIG_DFL;
+  (void) sigaction(SIGCHLD, &sa, NULL);
+
+  (void) setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof timeout);
+
+  if (!get_client_ids(fd, &uid, &gid))
+    fatal_perror("vlock-service: could not get client credentials");
+
+  terminal_fd = receive_terminal(fd);
+
+  if (terminal_fd < 0)
+    fatal_perror("vlock-service: could not receive terminal");
+
+  pw = getpwuid(uid);
+
+  if (pw == NULL)
+    fatal_perror("vlock-service: could not get user name");
+
+  username = strdup(pw->pw_name);
+
+  if (username == NULL)
+    fatal_perror("vlock-service: out of memory");
+
+  /* Become the client's user but keep the privileges of the service in the
+   * effective and saved IDs.  This is what the process looks like if a user
+   * runs the setuid vlock-main. */
+  if (initgroups(username, gid) < 0
+      || setresgid(gid, gid, gid) < 0
+      || setresuid(uid, 0, 0) < 0)
+    fatal_perror("vlock-service: could not switch user");
+
+  if (dup2(terminal_fd, STDIN_FILENO) < 0
+      || dup2(terminal_fd, STDOUT_FILENO) < 0
+      || dup2(terminal_fd, STDERR_FILENO) < 0)
+    fatal_perror("vlock-service: could not redirect stdio");
+
+  if (terminal_fd > STDERR_FILENO)
+    (void) close(terminal_fd);
+
+  client_fd = fd;
+
+  return username;
+}
+
+/* The listening socket and its source in the event loop. */
+static int listen_fd = -1;
+static struct event_source *listen_source;
+/* Set in the child process that serves a client. */
+static bool accepted;
+
+static void accept_client(void __attribute__((unused)) *data)
+{
+  int fd = accept4(listen_fd, NULL, NULL, SOCK_CLOEXEC);
+  pid_t pid;
+
+  if (fd < 0) {
+    if (errno == EINTR || errno == EAGAIN || errno == ECONNABORTED)
+      return;
+
+    fatal_perror("vlock-service: accept4() failed");
+  }
+
+  pid = fork();
+
+  if (pid == 0) {
+    /* The child must not share the event loop with the service. */
+    if (!event_after_fork())
+      fatal_perror("vlock-service: could not set up event loop");
+
+    event_remove(listen_source);
+    (void) close(listen_fd);
+
+    client_fd = fd;
+    accepted = true;
+    return;
+  }
+
+  if (pid < 0)
+    perror("vlock-service: fork() failed");
+
+  (void) close(fd);
+}
+
+char *run_service(const char *socket_path)
+{
+  struct sigaction sa;
+
+  if (getuid() != 0)
+    fatal_error("vlock-service: must be started by root");
+
+  listen_fd = create_socket(socket_path);
+
+  if (listen_fd < 0)
+    fatal_error("vlock-service: could not listen on '%s': %s", socket_path, STRERROR);
+
+  /* Let the kernel reap the children. */
+  (void) sigemptyset(&(sa.sa_mask));
+  sa.sa_flags = SA_NOCLDWAIT;
+  sa.sa_handler = SIG_IGN;
+  (void) sigaction(SIGCHLD, &sa, NULL);
+
+  /* Clients are accepted by the event loop so that the service can be
+   * terminated in between. */
+  listen_source = event_watch_fd(listen_fd, accept_client, NULL);
+
+  if (listen_source == NULL || !event_loop(&accepted))
+    fatal_perror("vlock-service: waiting for clients failed");
+
+  return serve_client(client_fd);
+}
+
+void service_unlocked(void)
+{
+  static const char status = 0;
+
+  if (client_fd >= 0)
+    (void) write(client_fd, &status, sizeof status);
+}
@@ -0,0 +1,28 @@
+/* service.h -- header file for the lock service of vlock,
+ *              the VT locking program for linux
+ *
+ * This program is copyright (C) 2007 Frank Benkstein, and is free
+ * software which is freely distributable under the terms of the
+ * GNU General Public License version 2, included as the file COPYING in this
+ * distribution.  It is NOT public domain software, and any
+ * redistribution not permitted by the GNU General Public License is
+ * expressly forbidden without prior written permission from
+ * the author.
+ *
+ */
+
+#include <stdbool.h>
+
+/* Listen on the given socket for lock requests.  Each request carries the
+ * terminal that should be locked as a file descriptor.  For each request a
+ * child process is forked in which this function returns.  In the child the
+ * terminal is connected to stdin, stdout and stderr and the real user and
+ * group IDs are set to those of the client while the effective IDs stay root,
+ * just as if vlock-main had been run as a setuid executable.  The name of the
+ * client's user is returned.  This function never returns in the parent and
+ * aborts on error. */
+char *run_service(const char *socket_path);
+
+/* Tell the client that its terminal was unlocked successfully.  Does nothing
+ * if vlock-main is not running as a service. */
+void service_unlocked(void);
@@ -0,0 +1,140 @@
+/* terminal.c -- terminal mode handling for vlock,
+ *               the VT locking program for linux
+ *
+ * This program is copyright (C) 2007 Frank Benkstein, and is free
+ * software which is freely distributable under the terms of the
+ * GNU General Public License version 2, included as the file COPYING in this
+ * distribution.  It is NOT public domain software, and any
+ * redistribution not permitted by the GNU General Public License is
+ * expressly forbidden without prior written permission from
+ * the author.
+ *
+ */
+
+/* Every unlock attempt switches the terminal between reading single
+ * characters, reading lines with echo and reading lines without echo.  Most
+ * of these switches used to be undone right away only to be done again by the
+ * next step.  Here the current attributes are cached and restoring them is
+ * deferred until the terminal is needed again, so that switches that cancel
+ * each other out never reach the terminal. */
+
+#include <unistd.h>
+#include <errno.h>
+#include <termios.h>
+
+#include "terminal.h"
+
+/* The terminal, or -1 if it was not initialized (successfully). */
+static int terminal_fd = -1;
+static bool initialized;
+
+/* The attributes when the terminal was initialized, the attributes that are
+ * set and the attributes that should be set. */
+static struct termios original;
+static struct termios current;
+static struct termios wanted;
+
+static unsigned long ioctl_count;
+
+bool terminal_init(int fd)
+{
+  initialized = true;
+
+  ioctl_count++;
+
+  if (tcgetattr(fd, &original) < 0) {
+    terminal_fd = -1;
+    return false;
+  }
+
+  terminal_fd = fd;
+  current = original;
+  wanted = original;
+
+  return true;
+}
+
+static void ensure_initialized(void)
+{
+  if (!initialized)
+    (void) terminal_init(STDIN_FILENO);
+}
+
+static tcflag_t change_flags(tcflag_t *flags, tcflag_t set, tcflag_t clear)
+{
+  tcflag_t old = *flags;
+  *flags = (old | set) & ~clear;
+  return old;
+}
+
+tcflag_t terminal_set_iflag(tcflag_t set, tcflag_t clear)
+{
+  ensure_initialized();
+  return change_flags(&wanted.c_iflag, set, clear);
+}
+
+tcflag_t terminal_set_lflag(tcflag_t set, tcflag_t clear)
+{
+  ensure_initialized();
+  return change_flags(&wanted.c_lflag, set, clear);
+}
+
+void terminal_reset_lflag(tcflag_t lflag)
+{
+  wanted.c_lflag = lflag;
+}
+
+/* Only the flags are ever changed. */
+static bool is_current(const struct termios *term)
+{
+  return term->c_iflag == current.c_iflag && term->c_lflag == current.c_lflag;
+}
+
+/* Set the given attributes.  TCSAFLUSH also discards unread input. */
+static bool set_attributes(const struct termios *term, bool discard)
+{
+  ioctl_count++;
+
+  if (tcsetattr(terminal_fd, discard ? TCSAFLUSH : TCSANOW, term) < 0)
+    return false;
+
+  current = *term;
+
+  return true;
+}
+
+bool terminal_apply(bool discard)
+{
+  ensure_initialized();
+
+  if (terminal_fd < 0) {
+    errno = ENOTTY;
+    return false;
+  }
+
+  if (!is_current(&wanted))
+    return set_attributes(&wanted, discard);
+
+  if (discard) {
+    ioctl_count++;
+    return tcflush(terminal_fd, TCIFLUSH) == 0;
+  }
+
+  return true;
+}
+
+void terminal_restore(void)
+{
+  if (terminal_fd < 0)
+    return;
+
+  wanted = original;
+
+  if (!is_current(&original))
+    (void) set_attributes(&original, false);
+}
+
+unsigned long terminal_ioctls(void)
+{
+  return ioctl_count;
+}
@@ -0,0 +1,49 @@
+/* terminal.h -- header file for the terminal mode handling of vlock,
+ *               the VT locking program for linux
+ *
+ * This program is copyright (C) 2007 Frank Benkstein, and is free
+ * software which is freely distributable under the terms of the
+ * GNU General Public License version 2, included as the file COPYING in this
+ * distribution.  It is NOT public domain software, and any
+ * redistribution not permitted by the GNU General Public License is
+ * expressly forbidden without prior written permission from
+ * the author.
+ *
+ */
+
+#include <stdbool.h>
+#include <termios.h>
+
+/* The attributes of the terminal are read once and cached.  Callers change
+ * the wanted flags, which is free, and the terminal is only changed by
+ * terminal_apply() if the wanted flags differ from the ones that are set.
+ * Changes made to the terminal behind the back of these functions are not
+ * noticed. */
+
+/* Read the attributes of the terminal on the given descriptor.  They are
+ * restored by terminal_restore().  If this is not called before any of the
+ * other functions the terminal on stdin is used.  Returns false and sets
+ * errno on error. */
+bool terminal_init(int fd);
+
+/* Set and clear the given input flags (c_iflag) in the wanted attributes.
+ * Returns the input flags that were wanted before. */
+tcflag_t terminal_set_iflag(tcflag_t set, tcflag_t clear);
+
+/* Set and clear the given local flags (c_lflag) in the wanted attributes.
+ * Returns the local flags that were wanted before. */
+tcflag_t terminal_set_lflag(tcflag_t set, tcflag_t clear);
+
+/* Go back to local flags that were returned by terminal_set_lflag(). */
+void terminal_reset_lflag(tcflag_t lflag);
+
+/* Change the terminal to the wanted attributes if they differ from the
+ * current ones.  If discard is true unread input is discarded even if
+ * nothing has to be changed.  Returns false and sets errno on error. */
+bool terminal_apply(bool discard);
+
+/* Restore the attributes the terminal had when it was initialized. */
+void terminal_restore(void);
+
+/* The number of ioctls that were issued on the terminal so far. */
+unsigned long terminal_ioctls(void);
@@ -0,0 +1,222 @@
+/* trace.c -- phase tracing for vlock,
+ *            the VT locking program for linux
+ *
+ * This program is copyright (C) 2007 Frank Benkstein, and is free
+ * software which is freely distributable under the terms of the
+ * GNU General Public License version 2, included as the file COPYING in this
+ * distribution.  It is NOT public domain software, and any
+ * redistribution not permitted by the GNU General Public License is
+ * expressly forbidden without prior written permission from
+ * the author.
+ *
+ */
+
+/* The beginning and end of every phase is stored as an event in a buffer of
+ * fixed size, so recording never allocates, and is written out only when
+ * vlock exits.  Events are recorded by the main thread and by the workers of
+ * the authentification, see auth-worker.c.  Every event takes a slot of the
+ * buffer atomically and is marked complete once it is filled in.  Events that
+ * do not fit into the buffer are dropped and counted. */
+
+#if !defined(__FreeBSD__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+
+#include <sys/types.h>
+#include <sys/syscall.h>
+
+#include "trace.h"
+#include "util.h"
+
+#define TRACE_EVENTS 4096
+#define TRACE_DETAIL_SIZE 48
+
+struct trace_event
+{
+  /* The name of the phase, NULL for the end of a phase. */
+  const char *name;
+  char detail[TRACE_DETAIL_SIZE];
+  struct timespec time;
+  pid_t thread;
+  bool complete;
+};
+
+static bool enabled;
+static char *trace_path;
+/* Time stamps are written relative to this. */
+static struct timespec start_time;
+
+static struct trace_event events[TRACE_EVENTS];
+/* The number of events recorded, dropped ones included. */
+static size_t nr_events;
+
+static __thread pid_t thread_id;
+
+static void add_event(const char *name, const char *detail)
+{
+  size_t i = __atomic_fetch_add(&nr_events, 1, __ATOMIC_RELAXED);
+  struct trace_event *e;
+
+  if (i >= TRACE_EVENTS)
+    return;
+
+  if (thread_id == 0)
+    thread_id = (pid_t) syscall(SYS_gettid);
+
+  e = &events[i];
+  e->name = name;
+  e->thread = thread_id;
+
+  if (detail != NULL)
+    (void) snprintf(e->detail, sizeof e->detail, "%s", detail);
+
+  (void) clock_gettime(CLOCK_MONOTONIC, &e->time);
+  __atomic_store_n(&e->complete, true, __ATOMIC_RELEASE);
+}
+
+void trace_begin(const char *name, const char *detail)
+{
+  if (enabled)
+    add_event(name, detail);
+}
+
+void trace_end(void)
+{
+  if (enabled)
+    add_event(NULL, NULL);
+}
+
+static void write_string(FILE *f, const char *s)
+{
+  fputc('"', f);
+
+  for (; *s != '\0'; s++) {
+    unsigned char c = *s;
+
+    if (c == '"' || c == '\\')
+      fprintf(f, "\\%c", c);
+    else if (c < 0x20)
+      fprintf(f, "\\u%04x", c);
+    else
+      fputc(c, f);
+  }
+
+  fputc('"', f);
+}
+
+static void write_event(FILE *f, const struct trace_event *e, pid_t pid)
+{
+  long long nsec = (e->time.tv_sec - start_time.tv_sec) * 1000000000LL
+    + (e->time.tv_nsec - start_time.tv_nsec);
+
+  fprintf(f, "{\"ph\":\"%c\",\"pid\":%d,\"tid\":%d,\"ts\":%lld.%03lld",
+      e->name != NULL ? 'B' : 'E', (int) pid, (int) e->thread,
+      nsec / 1000, nsec % 1000);
+
+  if (e->name != NULL) {
+    fputs(",\"name\":", f);
+    write_string(f, e->name);
+  }
+
+  if (e->detail[0] != '\0') {
+    fputs(",\"args\":{\"detail\":", f);
+    write_string(f, e->detail);
+    fputc('}', f);
+  }
+
+  fputc('}', f);
+}
+
+bool trace_write(const char *path)
+{
+  size_t n = __atomic_load_n(&nr_events, __ATOMIC_RELAXED);
+  size_t dropped = n > TRACE_EVENTS ? n - TRACE_EVENTS : 0;
+  uid_t euid = geteuid();
+  bool first = true;
+  pid_t pid = getpid();
+  FILE *f;
+  int fd;
+
+  /* vlock-main is most likely setuid root.  Do not let users write files they
+   * do not have access to. */
+  if (seteuid(getuid()) < 0)
+    return false;
+
+  fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_NOCTTY | O_CLOEXEC, 0644);
+
+  if (seteuid(euid) < 0)
+    fatal_perror("vlock: could not restore privileges");
+
+  if (fd < 0)
+    return false;
+
+  f = fdopen(fd, "w");
+
+  if (f == NULL) {
+    GUARD_ERRNO((void) close(fd));
+    return false;
+  }
+
+  fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[", f);
+
+  for (size_t i = 0; i < n && i < TRACE_EVENTS; i++) {
+    /* Skip events that are just being recorded. */
+    if (!__atomic_load_n(&events[i].complete, __ATOMIC_ACQUIRE))
+      continue;
+
+    if (!first)
+      fputc(',', f);
+
+    fputc('\n', f);
+    write_event(f, &events[i], pid);
+    first = false;
+  }
+
+  fprintf(f, "\n],\"otherData\":{\"dropped_events\":%zu}}\n", dropped);
+
+  if (ferror(f)) {
+    GUARD_ERRNO((void) fclose(f));
+    return false;
+  }
+
+  return fclose(f) == 0;
+}
+
+static void write_trace(void)
+{
+  if (!trace_write(trace_path))
+    fprintf(stderr, "vlock: could not write trace to %s: %s\n",
+        trace_path, STRERROR);
+}
+
+bool trace_init(void)
+{
+  const char *path = getenv("VLOCK_TRACE");
+
+  if (path == NULL || *path == '\0' || enabled)
+    return true;
+
+  trace_path = strdup(path);
+
+  if (trace_path == NULL)
+    return false;
+
+  if (atexit(write_trace) != 0) {
+    free(trace_path);
+    trace_path = NULL;
+    return false;
+  }
+
+  (void) clock_gettime(CLOCK_MONOTONIC, &start_time);
+  enabled = true;
+
+  return true;
+}
@@ -0,0 +1,37 @@
+/* trace.h -- header file for the phase tracing of vlock,
+ *            the VT locking program for linux
+ *
+ * This program is copyright (C) 2007 Frank Benkstein, and is free
+ * software which is freely distributable under the terms of the
+ * GNU General Public License version 2, included as the file COPYING in this
+ * distribution.  It is NOT public domain software, and any
+ * redistribution not permitted by the GNU General Public License is
+ * expressly forbidden without prior written permission from
+ * the author.
+ *
+ */
+
+#include <stdbool.h>
+
+/* Phases are only recorded if tracing was started by trace_init().  Otherwise
+ * recording costs nothing but a check of a flag. */
+
+/* Start tracing if VLOCK_TRACE is set.  The trace is written to the file it
+ * names when vlock exits.  This should be called before any other exit handler
+ * is registered so that their phases are part of the trace.  Returns false and
+ * sets errno on error. */
+bool trace_init(void);
+
+/* Record the beginning of a phase on the current thread.  The name must be a
+ * constant string, the detail is copied and may be NULL.  Phases of a thread
+ * must be nested. */
+void trace_begin(const char *name, const char *detail);
+
+/* Record the end of the phase that began last on the current thread. */
+void trace_end(void);
+
+/* Write the recorded phases to the given file in the trace event format of
+ * Chrome, which can be viewed with chrome://tracing or Perfetto.  The file is
+ * opened with the privileges of the real user.  Returns false and sets errno
+ * on error. */
+bool trace_write(const char *path);
@@ -18,37 +18,76 @@
 #include <stdarg.h>
 #include <stdio.h>
 #include <string.h>
+#include <ctype.h>
 #include <errno.h>
 #include <time.h>
 
 #include "util.h"
 
-/* Parse the given string (interpreted as seconds) into a
- * timespec.  On error NULL is returned.  The caller is responsible
- * to free the result.   The argument may be NULL, in which case NULL
- * is returned, too.  "0" is also parsed as NULL. */
-struct timespec *parse_seconds(const char *s)
+/* Parse the given string (interpreted as seconds, fractions allowed) into the
+ * given timespec.  Returns false if the string is NULL, invalid or zero.  The
+ * fraction is read digit by digit to avoid rounding errors, digits beyond
+ * nanoseconds are ignored. */
+bool parse_seconds(const char *s, struct timespec *timeout)
 {
-  if (s == NULL) {
-    return NULL;
-  } else {
-    char *n;
-    struct timespec *t = calloc(sizeof *t, 1);
+  long sec;
+  long nsec = 0;
+  char *n;
 
-    if (t == NULL)
-      return NULL;
+  if (s == NULL || !isdigit((unsigned char) *s))
+    return false;
 
-    t->tv_sec = strtol(s, &n, 10);
+  errno = 0;
+  sec = strtol(s, &n, 10);
 
-    if (*n != '\0' || t->tv_sec <= 0) {
-      free(t);
-      t = NULL;
-    }
+  if (errno != 0)
+    return false;
+
+  if (*n == '.') {
+    for (long scale = 100000000L; isdigit((unsigned char) *++n); scale /= 10)
+      nsec += (*n - '0') * scale;
+  }
+
+  if (*n != '\0' || (sec == 0 && nsec == 0))
+    return false;
+
+  timeout->tv_sec = sec;
+  timeout->tv_nsec = nsec;
+
+  return true;
+}
+
+void get_deadline(const struct timespec *timeout, struct timespec *deadline)
+{
+  (void) clock_gettime(CLOCK_MONOTONIC, deadline);
 
-    return t;
+  deadline->tv_sec += timeout->tv_sec;
+  deadline->tv_nsec += timeout->tv_nsec;
+
+  if (deadline->tv_nsec >= 1000000000L) {
+    deadline->tv_sec++;
+    deadline->tv_nsec -= 1000000000L;
   }
 }
 
+bool get_remaining(const struct timespec *deadline, struct timespec *remaining)
+{
+  struct timespec now;
+
+  (void) clock_gettime(CLOCK_MONOTONIC, &now);
+
+  remaining->tv_sec = deadline->tv_sec - now.tv_sec;
+  remaining->tv_nsec = deadline->tv_nsec - now.tv_nsec;
+
+  if (remaining->tv_nsec < 0) {
+    remaining->tv_sec--;
+    remaining->tv_nsec += 1000000000L;
+  }
+
+  return remaining->tv_sec > 0
+    || (remaining->tv_sec == 0 && remaining->tv_nsec > 0);
+}
+
 void fatal_error(const char *format, ...)
 {
   char *error;
@@ -11,15 +11,23 @@
  *
  */
 
+#include <stdbool.h>
 #include <stddef.h>
 
 struct timespec;
 
-/* Parse the given string (interpreted as seconds) into a
- * timespec.  On error NULL is returned.  The caller is responsible
- * to free the result.   The string may be NULL, in which case NULL
- * is returned, too. */
-struct timespec *parse_seconds(const char *s);
+/* Parse the given string (interpreted as seconds, fractions allowed) into the
+ * given timespec.  Returns false if the string is NULL, invalid or zero.
+ * Nothing is allocated. */
+bool parse_seconds(const char *s, struct timespec *timeout);
+
+/* Timeouts are measured against CLOCK_MONOTONIC.  Get the deadline that lies
+ * the given amount of time in the future. */
+void get_deadline(const struct timespec *timeout, struct timespec *deadline);
+
+/* Get the time until the given deadline.  Returns false if it has passed. */
+bool get_remaining(const struct timespec *deadline,
+    struct timespec *remaining);
 
 void fatal_error(const char *format, ...)
   __attribute__((noreturn, format(printf, 1, 2)));
@@ -0,0 +1,138 @@
+/* vlock-client.c -- lock service client for vlock,
+ *                   the VT locking program for linux
+ *
+ * This program is copyright (C) 2007 Frank Benkstein, and is free
+ * software which is freely distributable under the terms of the
+ * GNU General Public License version 2, included as the file COPYING in this
+ * distribution.  It is NOT public domain software, and any
+ * redistribution not permitted by the GNU General Public License is
+ * expressly forbidden without prior written permission from
+ * the author.
+ *
+ */
+
+/* Ask the lock service to lock the current terminal and wait until it is
+ * unlocked.  The service locks with the options and plugins it was started
+ * with.  If arguments are given or the service is not running vlock-main is
+ * executed directly instead. */
+
+#if !defined(__FreeBSD__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <errno.h>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+static int connect_service(const char *socket_path)
+{
+  struct sockaddr_un addr;
+  int fd;
+
+  memset(&addr, 0, sizeof addr);
+  addr.sun_family = AF_UNIX;
+
+  if (strlen(socket_path) >= sizeof addr.sun_path) {
+    errno = ENAMETOOLONG;
+    return -1;
+  }
+
+  strcpy(addr.sun_path, socket_path);
+
+  fd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+  if (fd < 0)
+    return -1;
+
+  if (connect(fd, (struct sockaddr *) &addr, sizeof addr) < 0) {
+    int errsv = errno;
+    (void) close(fd);
+    errno = errsv;
+    return -1;
+  }
+
+  return fd;
+}
+
+/* Send the terminal file descriptor to the service. */
+static int send_terminal(int fd, int terminal_fd)
+{
+  char data = 0;
+  struct iovec iov = { .iov_base = &data, .iov_len = sizeof data };
+  union {
+    struct cmsghdr header;
+    char buffer[CMSG_SPACE(sizeof (int))];
+  } control;
+  struct msghdr msg = {
+    .msg_iov = &iov,
+    .msg_iovlen = 1,
+    .msg_control = control.buffer,
+    .msg_controllen = sizeof control.buffer,
+  };
+  struct cmsghdr *cmsg;
+
+  memset(&control, 0, sizeof control);
+
+  cmsg = CMSG_FIRSTHDR(&msg);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN(sizeof (int));
+  memcpy(CMSG_DATA(cmsg), &terminal_fd, sizeof terminal_fd);
+
+  return sendmsg(fd, &msg, 0) == sizeof data ? 0 : -1;
+}
+
+int main(int argc, char *const argv[])
+{
+  struct sigaction sa;
+
+  /* Do not leave the terminal unprotected while the service locks it.  This
+   * is what the wrapper script does with trap. */
+  (void) sigemptyset(&(sa.sa_mask));
+  sa.sa_flags = SA_RESTART;
+  sa.sa_handler = SIG_IGN;
+  (void) sigaction(SIGHUP, &sa, NULL);
+  (void) sigaction(SIGINT, &sa, NULL);
+  (void) sigaction(SIGQUIT, &sa, NULL);
+  (void) sigaction(SIGTSTP, &sa, NULL);
+
+  if (argc <= 1) {
+    int fd = connect_service(VLOCK_SERVICE_SOCKET);
+
+    if (fd >= 0) {
+      char status;
+      ssize_t length;
+
+      if (send_terminal(fd, STDIN_FILENO) < 0) {
+        perror("vlock-client: could not send terminal");
+        exit(EXIT_FAILURE);
+      }
+
+      do {
+        length = read(fd, &status, sizeof status);
+      } while (length < 0 && errno == EINTR);
+
+      /* The connection is closed without a status if locking failed. */
+      exit(length == sizeof status && status == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+  }
+
+  /* Restore the default signal handlers for vlock-main. */
+  sa.sa_handler = SIG_DFL;
+  (void) sigaction(SIGHUP, &sa, NULL);
+  (void) sigaction(SIGINT, &sa, NULL);
+  (void) sigaction(SIGQUIT, &sa, NULL);
+  (void) sigaction(SIGTSTP, &sa, NULL);
+
+  (void) execv(VLOCK_MAIN, argv);
+
+  fprintf(stderr, "vlock-client: could not execute '%s': %s\n", VLOCK_MAIN, strerror(errno));
+  exit(EXIT_FAILURE);
+}
@@ -11,11 +11,17 @@
  *
  */
 
+#if !defined(__FreeBSD__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
+#include <stdbool.h>
 
 #include <pwd.h>
+#include <getopt.h>
 
 #include <termios.h>
 #include <unistd.h>
@@ -26,7 +32,13 @@
 
 #include "prompt.h"
 #include "auth.h"
+#include "backoff.h"
 #include "console_switch.h"
+#include "event.h"
+#include "rcfile.h"
+#include "service.h"
+#include "terminal.h"
+#include "trace.h"
 #include "util.h"
 
 #ifdef USE_PLUGINS
@@ -65,7 +77,148 @@ static char *get_username(void)
   return strdup(username);
 }
 
-static void terminate(int signum)
+/* Plugins requested through command line options. */
+static bool option_all;
+static bool option_new;
+static bool option_nosysrq;
+/* Timeout given on the command line. */
+static const char *option_timeout;
+/* Run as a lock service instead of locking the current terminal. */
+static bool option_service;
+
+/* Value returned by getopt_long() for options without a short form. */
+#define OPTION_SERVICE 256
+
+static void print_help(void)
+{
+  fprintf(stderr, "vlock: locks virtual consoles, saving your current session.\n");
+#ifdef USE_PLUGINS
+  fprintf(stderr, "Usage: vlock [options] [plugins...]\n");
+#else
+  fprintf(stderr, "Usage: vlock [options]\n");
+#endif
+  fprintf(stderr, "       Where [options] are any of:\n");
+  fprintf(stderr, "-c or --current: lock only this virtual console, allowing user to\n");
+  fprintf(stderr, "       switch to other virtual consoles.\n");
+  fprintf(stderr, "-a or --all: lock all virtual consoles by preventing other users\n");
+  fprintf(stderr, "       from switching virtual consoles.\n");
+#ifdef USE_PLUGINS
+  fprintf(stderr, "-n or --new: allocate a new virtual console before locking,\n");
+  fprintf(stderr, "       implies --all.\n");
+  fprintf(stderr, "-s or --disable-sysrq: disable SysRq while consoles are locked to\n");
+  fprintf(stderr, "       prevent killing vlock with SAK\n");
+  fprintf(stderr, "-t <seconds> or --timeout <seconds>: run screen saver plugins\n");
+  fprintf(stderr, "       after the given amount of time.\n");
+#endif
+  fprintf(stderr, "--service: wait for lock requests from vlock-client instead of\n");
+  fprintf(stderr, "       locking this terminal.  Only root may do this.\n");
+  fprintf(stderr, "-v or --version: Print the version number of vlock and exit.\n");
+  fprintf(stderr, "-h or --help: Print this help message and exit.\n");
+}
+
+/* Parse the command line options.  Returns the index of the first non-option
+ * argument, i.e. the first plugin name. */
+static int parse_options(int argc, char *const argv[])
+{
+  static const struct option long_options[] = {
+    { "all", no_argument, NULL, 'a' },
+    { "current", no_argument, NULL, 'c' },
+    { "new", no_argument, NULL, 'n' },
+    { "disable-sysrq", no_argument, NULL, 's' },
+    { "timeout", required_argument, NULL, 't' },
+    { "help", no_argument, NULL, 'h' },
+    { "version", no_argument, NULL, 'v' },
+    { "service", no_argument, NULL, OPTION_SERVICE },
+    { NULL, 0, NULL, 0 },
+  };
+  int c;
+
+  while ((c = getopt_long(argc, argv, "acnst:hv", long_options, NULL)) != -1) {
+    switch (c) {
+      case 'a':
+        option_all = true;
+        break;
+      case 'c':
+        option_all = option_new = option_nosysrq = false;
+        break;
+      case 'n':
+        option_new = true;
+        break;
+      case 's':
+        option_nosysrq = true;
+        break;
+      case 't':
+        option_timeout = optarg;
+        break;
+      case OPTION_SERVICE:
+        option_service = true;
+        break;
+      case 'h':
+        print_help();
+        exit(EXIT_SUCCESS);
+      case 'v':
+#ifdef USE_PLUGINS
+        fprintf(stderr, "vlock version %s\n", VLOCK_VERSION);
+#else
+        fprintf(stderr, "vlock version %s (no plugin support)\n", VLOCK_VERSION);
+#endif
+        exit(EXIT_SUCCESS);
+      default:
+        print_help();
+        exit(EXIT_FAILURE);
+    }
+  }
+
+  return optind;
+}
+
+/* Set up the default messages and read the user's configuration file.  The
+ * wrapper script sets VLOCK_RC to the empty string because it already sourced
+ * the file itself. */
+static void read_configuration(void)
+{
+  const char *rcfile = getenv("VLOCK_RC");
+  char *path = NULL;
+
+  /* Only set the default messages if they are not already set in the
+   * environment. */
+  (void) setenv("VLOCK_ALL_MESSAGE",
+      CLEAR_SCREEN
+      "The entire console display is now completely locked.\n"
+      "You will not be able to switch to another virtual console.\n"
+      "\n"
+      VLOCK_ENTER_PROMPT, 0);
+  (void) setenv("VLOCK_CURRENT_MESSAGE",
+      CLEAR_SCREEN
+      "This TTY is now locked.\n"
+      "\n"
+      VLOCK_ENTER_PROMPT, 0);
+
+  if (rcfile == NULL) {
+    const char *home = getenv("HOME");
+
+    if (home != NULL && asprintf(&path, "%s/.vlockrc", home) < 0)
+      fatal_error("vlock: out of memory");
+  } else if (*rcfile != '\0') {
+    path = strdup(rcfile);
+
+    if (path == NULL)
+      fatal_error("vlock: out of memory");
+  }
+
+  if (path != NULL) {
+    if (!read_rcfile(path) && errno != 0)
+      fprintf(stderr, "vlock: could not read '%s': %s\n", path, STRERROR);
+
+    free(path);
+  }
+
+  /* Command line options override the configuration file. */
+  if (option_timeout != NULL)
+    (void) setenv("VLOCK_TIMEOUT", option_timeout, 1);
+}
+
+static void terminate(void __attribute__((unused)) *data)
 {
   fprintf(stderr, "vlock: Terminated!\n");
   /* Call exit here to ensure atexit handlers are called. */
@@ -86,39 +239,91 @@ static void block_signals(void)
   (void) sigaction(SIGQUIT, &sa, NULL);
   (void) sigaction(SIGTSTP, &sa, NULL);
 
-  /* Install special handler for SIGTERM. */
-  sa.sa_flags = SA_RESETHAND;
-  sa.sa_handler = terminate;
-  (void) sigaction(SIGTERM, &sa, NULL);
+  /* SIGTERM is handled by the event loop. */
+  if (event_watch_signal(SIGTERM, terminate, NULL) == NULL)
+    fatal_perror("vlock: could not watch SIGTERM");
 }
 
-static struct termios old_term;
-
 static void setup_terminal(void)
 {
-  (void) tcgetattr(STDIN_FILENO, &old_term);
-  struct termios new_term = old_term;
+  trace_begin("setup_terminal", NULL);
+  (void) terminal_init(STDIN_FILENO);
   /* Pressing enter must yield line feed. */
-  new_term.c_iflag &= ~INLCR;
-  new_term.c_iflag |= ICRNL;
+  (void) terminal_set_iflag(ICRNL, INLCR);
   /* Disable terminal echoing and signals. */
-  new_term.c_lflag &= ~(ECHO | ISIG);
-  (void) tcsetattr(STDIN_FILENO, TCSANOW, &new_term);
+  (void) terminal_set_lflag(0, ECHO | ISIG);
+  (void) terminal_apply(false);
+  trace_end();
 }
 
 static void restore_terminal(void)
 {
   /* Restore the terminal. */
-  (void) tcsetattr(STDIN_FILENO, TCSANOW, &old_term);
+  trace_begin("restore_terminal", NULL);
+  terminal_restore();
+  trace_end();
 }
 
 static int auth_tries;
 
+/* Wait as long as the backoff policy says after a failed authentication
+ * attempt.  Console switch requests are still answered in the meantime. */
+static void auth_failed(void)
+{
+  struct timespec delay;
+
+  auth_tries++;
+
+  if (backoff_failure(&delay)) {
+    trace_begin("backoff", NULL);
+    (void) event_sleep(&delay);
+    trace_end();
+  }
+}
+
+/* Report how many terminal ioctls an unlock attempt needed. */
+static void debug_terminal_ioctls(unsigned long start)
+{
+  if (vlock_debug)
+    fprintf(stderr, "vlock: %lu terminal ioctls\n", terminal_ioctls() - start);
+}
+
+/* Report how long checking the password took.  Without preparation the first
+ * attempt is usually slower than the following ones. */
+static void debug_auth_latency(const char *user)
+{
+  struct timespec latency;
+
+  if (!vlock_debug)
+    return;
+
+  get_auth_latency(&latency);
+
+  fprintf(stderr, "vlock: checking the password of %s took %.3f ms (%s)\n",
+      user, latency.tv_sec * 1e3 + latency.tv_nsec / 1e6,
+      auth_tries == 0 ? "first attempt" : "later attempt");
+}
+
+static bool check_user(const char *user, struct timespec *timeout)
+{
+  bool result = authenticate(user, timeout);
+  debug_auth_latency(user);
+  return result;
+}
+
 static void auth_loop(const char *username)
 {
-  struct timespec *prompt_timeout;
-  struct timespec *wait_timeout;
+  struct timespec prompt_timeout_value;
+#ifdef USE_PLUGINS
+  struct timespec wait_timeout_value;
+#endif
+  struct timespec *prompt_timeout = NULL;
+  struct timespec *wait_timeout = NULL;
   char *vlock_message;
+  unsigned long ioctls;
+#ifndef NO_ROOT_PASS
+  char *single_prompt;
+#endif
 
   /* Get the vlock message from the environment. */
   vlock_message = getenv("VLOCK_MESSAGE");
@@ -131,16 +336,40 @@ static void auth_loop(const char *username)
   }
 
   /* Get the timeouts from the environment. */
-  prompt_timeout = parse_seconds(getenv("VLOCK_PROMPT_TIMEOUT"));
+  if (parse_seconds(getenv("VLOCK_PROMPT_TIMEOUT"), &prompt_timeout_value))
+    prompt_timeout = &prompt_timeout_value;
 #ifdef USE_PLUGINS
-  wait_timeout = parse_seconds(getenv("VLOCK_TIMEOUT"));
-#else
-  wait_timeout = NULL;
+  if (parse_seconds(getenv("VLOCK_TIMEOUT"), &wait_timeout_value))
+    wait_timeout = &wait_timeout_value;
+#endif
+#ifndef NO_ROOT_PASS
+  /* Prompt only once for the password of the user or root. */
+  single_prompt = getenv("VLOCK_SINGLE_PROMPT");
+
+  if (single_prompt != NULL && *single_prompt == '\0')
+    single_prompt = NULL;
 #endif
 
+  backoff_init(username);
+
+  /* Get ready while nobody is typing. */
+  {
+    const char *users[] = { username, "root" };
+    size_t n = 1;
+
+#ifndef NO_ROOT_PASS
+    if (strcmp(username, "root") != 0)
+      n = 2;
+#endif
+
+    prepare_authentication(users, n);
+  }
+
   for (;;) {
     char c;
 
+    ioctls = terminal_ioctls();
+
     /* Print vlock message if there is one. */
     if (vlock_message && *vlock_message) {
       fputs(vlock_message, stderr);
@@ -148,7 +377,14 @@ static void auth_loop(const char *username)
     }
 
     /* Wait for enter or escape to be pressed. */
+    trace_begin("locked", NULL);
     c = wait_for_character("\n\033", wait_timeout);
+    trace_end();
+
+    /* The terminal was hung up, e.g. because the client of the lock service
+     * was closed.  Waiting any longer would spin. */
+    if (c == 0 && errno != 0)
+      fatal_perror("vlock: could not read from the terminal");
 
     /* Escape was pressed or the timeout occurred. */
     if (c == '\033' || c == 0) {
@@ -158,6 +394,9 @@ static void auth_loop(const char *username)
       c = wait_for_character(NULL, NULL);
       plugin_hook("vlock_save_abort");
 
+      if (c == 0)
+        fatal_perror("vlock: could not read from the terminal");
+
       /* Do not require enter to be pressed twice. */
       if (c != '\n')
         continue;
@@ -166,37 +405,84 @@ static void auth_loop(const char *username)
 #endif
     }
 
+#ifndef NO_ROOT_PASS
+    if (single_prompt && strcmp(username, "root") != 0) {
+      /* Try authentication as user and root with the same password. */
+      const char *users[] = { username, "root" };
+
+      bool result = auth_any(users, 2, prompt_timeout);
+
+      debug_auth_latency(username);
+
+      if (result)
+        break;
+
+      auth_failed();
+      debug_terminal_ioctls(ioctls);
+      continue;
+    }
+#endif
+
     /* Try authentication as user. */
-    if (auth(username, prompt_timeout))
+    if (check_user(username, prompt_timeout))
       break;
-    else
-      sleep(1);
 
 #ifndef NO_ROOT_PASS
-    if (strcmp(username, "root") != 0) {
-      /* Try authentication as root. */
-      if (auth("root", prompt_timeout))
-        break;
-      else
-        sleep(1);
-    }
+    /* Try authentication as root right away, the attempt is not over yet. */
+    if (strcmp(username, "root") != 0 && check_user("root", prompt_timeout))
+      break;
 #endif
 
-    auth_tries++;
+    auth_failed();
+    debug_terminal_ioctls(ioctls);
   }
 
-  /* Free timeouts memory. */
-  free(wait_timeout);
-  free(prompt_timeout);
+  backoff_success();
+  debug_terminal_ioctls(ioctls);
 }
 
 void display_auth_tries(void)
 {
-  if (auth_tries > 0)
-    fprintf(stderr, "%d failed authentication %s.\n", auth_tries, auth_tries > 1 ? "tries" : "try");
+  struct timespec delay;
+
+  if (auth_tries == 0)
+    return;
+
+  backoff_total(&delay);
+
+  fprintf(stderr, "%d failed authentication %s, %ld.%ld seconds delay.\n",
+      auth_tries, auth_tries > 1 ? "tries" : "try",
+      (long) delay.tv_sec, delay.tv_nsec / 100000000L);
 }
 
 #ifdef USE_PLUGINS
+static void load_named_plugin(const char *name)
+{
+  if (!load_plugin(name))
+    fatal_error("vlock: loading plugin '%s' failed: %s", name, STRERROR);
+}
+
+/* Load the plugins from the given space separated list. */
+static void load_plugin_list(const char *plugin_list)
+{
+  char *s;
+
+  if (plugin_list == NULL)
+    return;
+
+  s = strdup(plugin_list);
+
+  if (s == NULL)
+    fatal_error("vlock: out of memory");
+
+  for (char *saveptr, *name = strtok_r(s, " \t\n", &saveptr);
+      name != NULL;
+      name = strtok_r(NULL, " \t\n", &saveptr))
+    load_named_plugin(name);
+
+  free(s);
+}
+
 static void call_end_hook(void)
 {
   (void) plugin_hook("vlock_end");
@@ -207,22 +493,37 @@ static void call_end_hook(void)
 int main(int argc, char *const argv[])
 {
   char *username;
+  int first_plugin = parse_options(argc, argv);
+
+  read_configuration();
+
+  /* Before any other exit handler is registered. */
+  if (!trace_init())
+    fatal_perror("vlock: could not start tracing");
 
   vlock_debug = (getenv("VLOCK_DEBUG") != NULL);
 
   block_signals();
 
-  username = get_username();
-
-  if (username == NULL)
-    fatal_perror("vlock: could not get username");
+  if (option_service && getuid() != 0)
+    fatal_error("vlock: only root may run the lock service");
 
   ensure_atexit(display_auth_tries);
 
 #ifdef USE_PLUGINS
-  for (int i = 1; i < argc; i++)
-    if (!load_plugin(argv[i]))
-      fatal_error("vlock: loading plugin '%s' failed: %s", argv[i], STRERROR);
+  if (option_all)
+    load_named_plugin("all");
+
+  if (option_new)
+    load_named_plugin("new");
+
+  if (option_nosysrq)
+    load_named_plugin("nosysrq");
+
+  for (int i = first_plugin; i < argc; i++)
+    load_named_plugin(argv[i]);
+
+  load_plugin_list(getenv("VLOCK_PLUGINS"));
 
   ensure_atexit(unload_plugins);
 
@@ -232,12 +533,52 @@ int main(int argc, char *const argv[])
     else
       fatal_error("vlock: error resolving plugin dependencies: %s", STRERROR);
   }
+#else /* !USE_PLUGINS */
+  if (option_new || option_nosysrq)
+    fatal_error("vlock: plugin support disabled");
+
+  /* Emulate pseudo plugin "all". */
+  if (first_plugin == argc - 1 && strcmp(argv[first_plugin], "all") == 0)
+    option_all = true;
+  else if (first_plugin < argc)
+    fatal_error("vlock: plugin support disabled");
+#endif
+
+  if (option_service) {
+#ifdef USE_PLUGINS
+    /* The clients would each open the modules when calling the first hook. */
+    if (!open_plugins())
+      exit(EXIT_FAILURE);
+#endif
+
+    /* Load the authentication backend once for all clients.  They then only
+     * have to look up their users. */
+    auth_preload("root");
+
+    /* Everything above is done only once.  The service returns in a new child
+     * process for every terminal that should be locked. */
+    username = run_service(VLOCK_SERVICE_SOCKET);
+
+#ifdef USE_PLUGINS
+    /* The plugins were loaded as root.  Make sure the user may actually use
+     * them. */
+    if (!check_plugins())
+      exit(EXIT_FAILURE);
+#endif
+  } else {
+    trace_begin("get_username", NULL);
+    username = get_username();
+    trace_end();
+
+    if (username == NULL)
+      fatal_perror("vlock: could not get username");
+  }
 
+#ifdef USE_PLUGINS
   plugin_hook("vlock_start");
   ensure_atexit(call_end_hook);
 #else /* !USE_PLUGINS */
-  /* Emulate pseudo plugin "all". */
-  if (argc == 2 && (strcmp(argv[1], "all") == 0)) {
+  if (option_all) {
     if (!lock_console_switch()) {
       if (errno)
         perror("vlock: could not disable console switching");
@@ -246,8 +587,6 @@ int main(int argc, char *const argv[])
     }
 
     ensure_atexit((void (*)(void))unlock_console_switch);
-  } else if (argc > 1) {
-    fatal_error("vlock: plugin support disabled");
   }
 #endif
 
@@ -259,6 +598,8 @@ int main(int argc, char *const argv[])
 
   auth_loop(username);
 
+  service_unlocked();
+
   free(username);
 
   exit(0);
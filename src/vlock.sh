@@ -224,6 +224,16 @@ main() {
   # Export variables for vlock-main.
   export_if_set VLOCK_TIMEOUT VLOCK_PROMPT_TIMEOUT
   export_if_set VLOCK_MESSAGE VLOCK_ALL_MESSAGE VLOCK_CURRENT_MESSAGE
+  export_if_set VLOCK_SINGLE_PROMPT
+  export_if_set VLOCK_BACKOFF_FREE VLOCK_BACKOFF_DELAY VLOCK_BACKOFF_MAX
+  export_if_set VLOCK_BACKOFF_PERSIST
+  export_if_set VLOCK_HOOK_BUDGET VLOCK_HOOK_POLICY
+  export_if_set VLOCK_TRACE VLOCK_DEBUG
+
+  # The configuration file was already sourced above.  Tell vlock-main not to
+  # read it again.
+  VLOCK_RC=""
+  export VLOCK_RC
 
   if [ "${VLOCK_ENABLE_PLUGINS}" = "yes" ] ; then
     exec "${VLOCK_MAIN}" ${plugins} ${VLOCK_PLUGINS} "$@"
@@ -0,0 +1,76 @@
+/* auth-bench.c -- stand-in authentification routine for benchmarking vlock,
+ *                 the VT locking program for linux
+ *
+ * This program is copyright (C) 2007 Frank Benkstein, and is free
+ * software which is freely distributable under the terms of the
+ * GNU General Public License version 2, included as the file COPYING in this
+ * distribution.  It is NOT public domain software, and any
+ * redistribution not permitted by the GNU General Public License is
+ * expressly forbidden without prior written permission from
+ * the author.
+ *
+ */
+
+/* This backend accepts the password given in VLOCK_BENCH_PASSWORD (or "bench")
+ * for every user.  It is only linked into vlock-main-bench which is never
+ * installed. */
+
+#if !defined(__FreeBSD__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "auth.h"
+
+#define DEFAULT_PASSWORD "bench"
+
+bool auth_password(const char *user, const char *password)
+{
+  const char *expected = getenv("VLOCK_BENCH_PASSWORD");
+
+  (void) user;
+
+  if (expected == NULL)
+    expected = DEFAULT_PASSWORD;
+
+  return strcmp(password, expected) == 0;
+}
+
+void auth_prepare(const char *user)
+{
+  (void) user;
+}
+
+void auth_preload(const char *user)
+{
+  (void) user;
+}
+
+bool auth(const char *user, struct timespec *timeout)
+{
+  char *msg;
+  char *pwd;
+  bool result;
+
+  if (asprintf(&msg, "%s's Password: ", user) < 0)
+    return false;
+
+  pwd = auth_prompt(msg, false, timeout);
+  free(msg);
+
+  if (pwd == NULL)
+    return false;
+
+  result = auth_password(user, pwd);
+
+  if (!result)
+    fprintf(stderr, "vlock: Authentication error\n");
+
+  free(pwd);
+
+  return result;
+}
@@ -0,0 +1,11 @@
+/* builtin_order.h -- generated by builtin-order, do not edit */
+
+/* Position of each builtin module in the precomputed order. */
+static const size_t builtin_ranks[] = {
+  0,
+};
+
+/* Builtin modules that cannot be loaded at the same time. */
+static const bool builtin_conflict_table[1][1] = {
+  { false, },
+};
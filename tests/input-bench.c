@@ -0,0 +1,165 @@
+/* input-bench.c -- terminal input benchmark for vlock,
+ *                  the VT locking program for linux
+ *
+ * This program is copyright (C) 2007 Frank Benkstein, and is free
+ * software which is freely distributable under the terms of the
+ * GNU General Public License version 2, included as the file COPYING in this
+ * distribution.  It is NOT public domain software, and any
+ * redistribution not permitted by the GNU General Public License is
+ * expressly forbidden without prior written permission from
+ * the author.
+ *
+ */
+
+/* Measure how much CPU time wait_for_character() needs to get through a flood
+ * of input, like a paste or a barcode scanner typing into the locked
+ * terminal.  A child process waits for a newline on the slave side of a
+ * pseudo terminal while the given number of megabytes of other characters
+ * followed by a newline is written to the master side.  The CPU time of the
+ * child is reported per megabyte. */
+
+#if !defined(__FreeBSD__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <termios.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+
+#include "prompt.h"
+
+#define CHUNK_SIZE 65536
+
+static double seconds(struct timeval t)
+{
+  return t.tv_sec + t.tv_usec / 1e6;
+}
+
+/* Wait for the newline on the terminal connected to stdin. */
+static void run_child(int ready_fd)
+{
+  struct termios term;
+  char c;
+
+  /* Just like vlock-main while it waits for enter. */
+  (void) tcgetattr(STDIN_FILENO, &term);
+  term.c_lflag &= ~(ECHO | ICANON | ISIG);
+  (void) tcsetattr(STDIN_FILENO, TCSANOW, &term);
+
+  (void) write(ready_fd, "", 1);
+  (void) close(ready_fd);
+
+  c = wait_for_character("\n", NULL);
+
+  _exit(c == '\n' ? 0 : 1);
+}
+
+static void usage(const char *name)
+{
+  fprintf(stderr, "Usage: %s [-m megabytes]\n", name);
+  exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *const argv[])
+{
+  size_t megabytes = 16;
+  char chunk[CHUNK_SIZE];
+  struct timespec start;
+  struct timespec end;
+  struct rusage usage_data;
+  int ready_pipe[2];
+  int master_fd;
+  int slave_fd;
+  int status;
+  pid_t pid;
+  char c;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "m:")) != -1) {
+    if (opt == 'm')
+      megabytes = strtoul(optarg, NULL, 10);
+    else
+      usage(argv[0]);
+  }
+
+  if (megabytes == 0)
+    usage(argv[0]);
+
+  master_fd = posix_openpt(O_RDWR | O_NOCTTY);
+
+  if (master_fd < 0 || grantpt(master_fd) < 0 || unlockpt(master_fd) < 0) {
+    perror("input-bench: could not open pseudo terminal");
+    exit(EXIT_FAILURE);
+  }
+
+  slave_fd = open(ptsname(master_fd), O_RDWR | O_NOCTTY);
+
+  if (slave_fd < 0 || pipe(ready_pipe) < 0) {
+    perror("input-bench: could not open pseudo terminal");
+    exit(EXIT_FAILURE);
+  }
+
+  pid = fork();
+
+  if (pid < 0) {
+    perror("input-bench: fork() failed");
+    exit(EXIT_FAILURE);
+  }
+
+  if (pid == 0) {
+    (void) close(master_fd);
+    (void) close(ready_pipe[0]);
+    (void) dup2(slave_fd, STDIN_FILENO);
+    (void) close(slave_fd);
+    run_child(ready_pipe[1]);
+  }
+
+  (void) close(slave_fd);
+  (void) close(ready_pipe[1]);
+
+  if (read(ready_pipe[0], &c, 1) != 1) {
+    fprintf(stderr, "input-bench: child did not start\n");
+    exit(EXIT_FAILURE);
+  }
+
+  memset(chunk, 'x', sizeof chunk);
+
+  (void) clock_gettime(CLOCK_MONOTONIC, &start);
+
+  for (size_t i = 0; i < (megabytes << 20) / sizeof chunk; i++) {
+    if (write(master_fd, chunk, sizeof chunk) != sizeof chunk) {
+      perror("input-bench: write() failed");
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  if (write(master_fd, "\n", 1) != 1) {
+    perror("input-bench: write() failed");
+    exit(EXIT_FAILURE);
+  }
+
+  if (wait4(pid, &status, 0, &usage_data) != pid
+      || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+    fprintf(stderr, "input-bench: child failed\n");
+    exit(EXIT_FAILURE);
+  }
+
+  (void) clock_gettime(CLOCK_MONOTONIC, &end);
+
+  printf("input    %zu MiB %8.1f ms wall %8.3f ms cpu/MiB (user %.3f, sys %.3f)\n",
+      megabytes,
+      (end.tv_sec - start.tv_sec) * 1e3 + (end.tv_nsec - start.tv_nsec) / 1e6,
+      (seconds(usage_data.ru_utime) + seconds(usage_data.ru_stime)) * 1e3 / megabytes,
+      seconds(usage_data.ru_utime) * 1e3 / megabytes,
+      seconds(usage_data.ru_stime) * 1e3 / megabytes);
+
+  return 0;
+}
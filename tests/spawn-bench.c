@@ -0,0 +1,160 @@
+/* spawn-bench.c -- child creation benchmark for vlock,
+ *                  the VT locking program for linux
+ *
+ * This program is copyright (C) 2007 Frank Benkstein, and is free
+ * software which is freely distributable under the terms of the
+ * GNU General Public License version 2, included as the file COPYING in this
+ * distribution.  It is NOT public domain software, and any
+ * redistribution not permitted by the GNU General Public License is
+ * expressly forbidden without prior written permission from
+ * the author.
+ *
+ */
+
+/* Measure how many children create_child() can run per second.  The given
+ * command is run
+ *
+ * spawn:  directly, i.e. the way scripts are run, and
+ * fork:   from a function child that calls execv() itself, i.e. the way
+ *         every child was created before posix_spawn() was used.
+ *
+ * With -m the given number of megabytes is allocated and touched first to
+ * make the address space look more like vlock-main with its libraries and
+ * modules.  With -f the limit of file descriptors is raised to the given
+ * number and a descriptor just below it is opened, which shows how the time
+ * to close all descriptors in the child depends on the limit. */
+
+#if !defined(__FreeBSD__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+
+#include "process.h"
+
+/* Kept reachable so the allocation is not optimized away. */
+char *ballast;
+
+static double now(void)
+{
+  struct timespec t;
+  (void) clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+static int exec_function(void *argument)
+{
+  char *const *argv = argument;
+
+  (void) execv(argv[0], argv);
+  return 1;
+}
+
+static void run(const char *name, size_t iterations, bool use_function,
+    char *const argv[])
+{
+  double start = now();
+
+  for (size_t i = 0; i < iterations; i++) {
+    struct child_process child = {
+      .path = argv[0],
+      .argv = (const char *const *) argv,
+      .function = use_function ? exec_function : NULL,
+      .argument = (void *) argv,
+      .stdin_fd = REDIRECT_DEV_NULL,
+      .stdout_fd = REDIRECT_DEV_NULL,
+      .stderr_fd = NO_REDIRECT,
+    };
+
+    if (!create_child(&child)) {
+      perror("spawn-bench: could not create child");
+      exit(EXIT_FAILURE);
+    }
+
+    (void) waitpid(child.pid, NULL, 0);
+  }
+
+  printf("%-8s n=%-6zu %10.1f spawns/s\n", name, iterations,
+      iterations / (now() - start));
+}
+
+static void usage(const char *name)
+{
+  fprintf(stderr, "Usage: %s [-n iterations] [-m megabytes] [-f fd-limit] command [arguments...]\n", name);
+  exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *const argv[])
+{
+  size_t iterations = 1000;
+  size_t megabytes = 0;
+  rlim_t fd_limit = 0;
+  int c;
+
+  while ((c = getopt(argc, argv, "+n:m:f:")) != -1) {
+    switch (c) {
+      case 'n':
+        iterations = strtoul(optarg, NULL, 10);
+        break;
+      case 'm':
+        megabytes = strtoul(optarg, NULL, 10);
+        break;
+      case 'f':
+        fd_limit = strtoul(optarg, NULL, 10);
+        break;
+      default:
+        usage(argv[0]);
+    }
+  }
+
+  if (optind >= argc || iterations == 0)
+    usage(argv[0]);
+
+  if (megabytes > 0) {
+    ballast = malloc(megabytes << 20);
+
+    if (ballast == NULL) {
+      perror("spawn-bench: out of memory");
+      exit(EXIT_FAILURE);
+    }
+
+    memset(ballast, 1, megabytes << 20);
+  }
+
+  if (fd_limit > 0) {
+    struct rlimit r;
+
+    if (getrlimit(RLIMIT_NOFILE, &r) < 0) {
+      perror("spawn-bench: could not get the limit of file descriptors");
+      exit(EXIT_FAILURE);
+    }
+
+    /* Stay within the hard limit. */
+    if (r.rlim_max != RLIM_INFINITY && fd_limit > r.rlim_max)
+      fd_limit = r.rlim_max;
+
+    r.rlim_cur = fd_limit;
+
+    if (setrlimit(RLIMIT_NOFILE, &r) < 0
+        || dup2(STDERR_FILENO, fd_limit - 1) < 0) {
+      perror("spawn-bench: could not raise the limit of file descriptors");
+      exit(EXIT_FAILURE);
+    }
+
+    printf("fd limit %ju\n", (uintmax_t) fd_limit);
+  }
+
+  run("spawn", iterations, false, argv + optind);
+  run("fork", iterations, true, argv + optind);
+
+  return 0;
+}
@@ -0,0 +1,180 @@
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include <CUnit/CUnit.h>
+
+#include "auth.h"
+#include "event.h"
+
+#include "test_auth-worker.h"
+
+/* Stand-in backend.  The user name says what to do. */
+bool auth(const char *user, struct timespec *timeout)
+{
+  (void) timeout;
+
+  if (strcmp(user, "slow") == 0) {
+    (void) nanosleep(&(struct timespec){ 0, 100000000 }, NULL);
+    return true;
+  }
+
+  if (strcmp(user, "hang") == 0) {
+    (void) nanosleep(&(struct timespec){ 0, 500000000 }, NULL);
+    return true;
+  }
+
+  if (strcmp(user, "prompt") == 0) {
+    char *answer = auth_prompt("Password: ", false, NULL);
+    bool result = (answer != NULL && strcmp(answer, "secret") == 0);
+
+    free(answer);
+    return result;
+  }
+
+  return false;
+}
+
+/* The password is right if it is the user name. */
+bool auth_password(const char *user, const char *password)
+{
+  return strcmp(user, password) == 0;
+}
+
+/* Each preparation writes a byte to this pipe. */
+static int prepared_fds[2] = { -1, -1 };
+
+void auth_prepare(const char *user)
+{
+  (void) user;
+  (void) write(prepared_fds[1], "", 1);
+}
+
+static double now(void)
+{
+  struct timespec t;
+  (void) clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+static void set_flag(void *data)
+{
+  bool *flag = data;
+  *flag = true;
+}
+
+/* Put the given input on stdin and return the old stdin. */
+static int redirect_stdin(const char *input)
+{
+  int pipe_fds[2];
+  int old_stdin = dup(STDIN_FILENO);
+
+  CU_ASSERT(pipe(pipe_fds) == 0);
+  CU_ASSERT(write(pipe_fds[1], input, strlen(input)) == (ssize_t) strlen(input));
+  (void) close(pipe_fds[1]);
+  (void) dup2(pipe_fds[0], STDIN_FILENO);
+  (void) close(pipe_fds[0]);
+
+  return old_stdin;
+}
+
+static void restore_stdin(int old_stdin)
+{
+  (void) dup2(old_stdin, STDIN_FILENO);
+  (void) close(old_stdin);
+}
+
+void test_authenticate_events(void)
+{
+  bool fired = false;
+  struct event_source *timer = event_add_timer(&(struct timespec){ 0, 10000000 },
+      set_flag, &fired);
+
+  CU_ASSERT_PTR_NOT_NULL(timer);
+
+  /* The timer fires while the worker is busy. */
+  CU_ASSERT(authenticate("slow", NULL));
+  CU_ASSERT(fired);
+
+  event_remove(timer);
+
+  CU_ASSERT(!authenticate("nobody", NULL));
+}
+
+void test_authenticate_timeout(void)
+{
+  double start = now();
+
+  CU_ASSERT(!authenticate("hang", &(struct timespec){ 0, 50000000 }));
+  CU_ASSERT(now() - start < 0.4);
+}
+
+void test_authenticate_prompt(void)
+{
+  int old_stdin = redirect_stdin("secret\n");
+
+  CU_ASSERT(authenticate("prompt", NULL));
+
+  restore_stdin(old_stdin);
+}
+
+void test_auth_any(void)
+{
+  const char *users[] = { "user", "root" };
+  int old_stdin;
+
+  old_stdin = redirect_stdin("root\n");
+  CU_ASSERT(auth_any(users, 2, NULL));
+  restore_stdin(old_stdin);
+
+  old_stdin = redirect_stdin("other\n");
+  CU_ASSERT(!auth_any(users, 2, NULL));
+  restore_stdin(old_stdin);
+}
+
+void test_auth_latency(void)
+{
+  struct timespec latency;
+
+  CU_ASSERT(authenticate("slow", NULL));
+
+  get_auth_latency(&latency);
+  CU_ASSERT(latency.tv_sec == 0 && latency.tv_nsec >= 100000000);
+}
+
+void test_prepare_authentication(void)
+{
+  const char *users[] = { "user", "root" };
+  char buffer[2];
+  size_t prepared = 0;
+
+  CU_ASSERT(pipe(prepared_fds) == 0);
+
+  prepare_authentication(users, 2);
+
+  while (prepared < sizeof buffer) {
+    ssize_t n = read(prepared_fds[0], buffer, sizeof buffer - prepared);
+
+    if (n <= 0)
+      break;
+
+    prepared += n;
+  }
+
+  CU_ASSERT(prepared == 2);
+
+  (void) close(prepared_fds[0]);
+  (void) close(prepared_fds[1]);
+}
+
+CU_TestInfo auth_worker_tests[] = {
+  { "test_authenticate_events", test_authenticate_events },
+  { "test_authenticate_timeout", test_authenticate_timeout },
+  { "test_authenticate_prompt", test_authenticate_prompt },
+  { "test_auth_any", test_auth_any },
+  { "test_auth_latency", test_auth_latency },
+  { "test_prepare_authentication", test_prepare_authentication },
+  CU_TEST_INFO_NULL,
+};
@@ -0,0 +1 @@
+extern CU_TestInfo auth_worker_tests[];
@@ -0,0 +1,129 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <time.h>
+
+#include <CUnit/CUnit.h>
+
+#include "backoff.h"
+
+#include "test_backoff.h"
+
+#define STATE_FILE VLOCK_STATE_DIR "/failures"
+
+static bool delay_is(struct timespec *delay, time_t sec, long nsec)
+{
+  return delay->tv_sec == sec && delay->tv_nsec == nsec;
+}
+
+void test_backoff_policy(void)
+{
+  struct timespec delay;
+
+  (void) setenv("VLOCK_BACKOFF_FREE", "2", 1);
+  (void) setenv("VLOCK_BACKOFF_DELAY", "0.5", 1);
+  (void) setenv("VLOCK_BACKOFF_MAX", "3", 1);
+  (void) unsetenv("VLOCK_BACKOFF_PERSIST");
+
+  backoff_init("user");
+
+  CU_ASSERT(!backoff_failure(&delay));
+  CU_ASSERT(!backoff_failure(&delay));
+  CU_ASSERT(backoff_failure(&delay) && delay_is(&delay, 0, 500000000));
+  CU_ASSERT(backoff_failure(&delay) && delay_is(&delay, 1, 0));
+  CU_ASSERT(backoff_failure(&delay) && delay_is(&delay, 2, 0));
+  CU_ASSERT(backoff_failure(&delay) && delay_is(&delay, 3, 0));
+  CU_ASSERT(backoff_failure(&delay) && delay_is(&delay, 3, 0));
+
+  backoff_total(&delay);
+  CU_ASSERT(delay_is(&delay, 9, 500000000));
+
+  /* The failures are forgotten but the delays still count. */
+  backoff_success();
+
+  CU_ASSERT(!backoff_failure(&delay));
+  backoff_total(&delay);
+  CU_ASSERT(delay_is(&delay, 9, 500000000));
+}
+
+void test_backoff_defaults(void)
+{
+  struct timespec delay;
+
+  (void) setenv("VLOCK_BACKOFF_FREE", "-1", 1);
+  (void) setenv("VLOCK_BACKOFF_DELAY", "0", 1);
+  (void) unsetenv("VLOCK_BACKOFF_MAX");
+  (void) unsetenv("VLOCK_BACKOFF_PERSIST");
+
+  backoff_init("user");
+
+  CU_ASSERT(!backoff_failure(&delay));
+  CU_ASSERT(backoff_failure(&delay) && delay_is(&delay, 1, 0));
+
+  for (int i = 0; i < 100; i++)
+    (void) backoff_failure(&delay);
+
+  CU_ASSERT(delay_is(&delay, 30, 0));
+
+  (void) unsetenv("VLOCK_BACKOFF_FREE");
+  (void) unsetenv("VLOCK_BACKOFF_DELAY");
+}
+
+static bool state_is_empty(void)
+{
+  FILE *f = fopen(STATE_FILE, "r");
+  bool result = (f != NULL && fgetc(f) == EOF);
+
+  if (f != NULL)
+    (void) fclose(f);
+
+  return result;
+}
+
+void test_backoff_persist(void)
+{
+  struct timespec delay;
+
+  /* The state file is only written by root. */
+  if (geteuid() != 0)
+    return;
+
+  (void) unlink(STATE_FILE);
+  (void) setenv("VLOCK_BACKOFF_FREE", "1", 1);
+  (void) setenv("VLOCK_BACKOFF_PERSIST", "y", 1);
+
+  backoff_init("user");
+  CU_ASSERT(!backoff_failure(&delay));
+  CU_ASSERT(backoff_failure(&delay));
+
+  backoff_init("other");
+  CU_ASSERT(!backoff_failure(&delay));
+
+  /* Like a restart. */
+  backoff_init("user");
+  CU_ASSERT(backoff_failure(&delay) && delay_is(&delay, 2, 0));
+  backoff_success();
+
+  backoff_init("user");
+  CU_ASSERT(!backoff_failure(&delay));
+  backoff_success();
+
+  backoff_init("other");
+  CU_ASSERT(backoff_failure(&delay) && delay_is(&delay, 1, 0));
+  backoff_success();
+
+  /* Users without failures have no line. */
+  CU_ASSERT(state_is_empty());
+
+  (void) unlink(STATE_FILE);
+  (void) unsetenv("VLOCK_BACKOFF_FREE");
+  (void) unsetenv("VLOCK_BACKOFF_PERSIST");
+  backoff_init("user");
+}
+
+CU_TestInfo backoff_tests[] = {
+  { "test_backoff_policy", test_backoff_policy },
+  { "test_backoff_defaults", test_backoff_defaults },
+  { "test_backoff_persist", test_backoff_persist },
+  CU_TEST_INFO_NULL,
+};
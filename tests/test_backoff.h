@@ -0,0 +1 @@
+extern CU_TestInfo backoff_tests[];
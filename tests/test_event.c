@@ -0,0 +1,130 @@
+#include <stdbool.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include <CUnit/CUnit.h>
+
+#include "event.h"
+
+#include "test_event.h"
+
+static void set_flag(void *data)
+{
+  bool *flag = data;
+  *flag = true;
+}
+
+void test_event_watch_fd(void)
+{
+  int pipe_fds[2];
+  bool readable = false;
+  struct event_source *source;
+
+  CU_ASSERT(pipe(pipe_fds) == 0);
+
+  source = event_watch_fd(pipe_fds[0], set_flag, &readable);
+  CU_ASSERT_PTR_NOT_NULL(source);
+
+  CU_ASSERT(write(pipe_fds[1], "x", 1) == 1);
+  CU_ASSERT(event_loop(&readable));
+
+  event_remove(source);
+  (void) close(pipe_fds[0]);
+  (void) close(pipe_fds[1]);
+}
+
+void test_event_add_timer(void)
+{
+  struct timespec timeout = { 0, 20000000 };
+  struct timespec before;
+  struct timespec after;
+  bool expired = false;
+  struct event_source *timer;
+
+  (void) clock_gettime(CLOCK_MONOTONIC, &before);
+
+  timer = event_add_timer(&timeout, set_flag, &expired);
+  CU_ASSERT_PTR_NOT_NULL(timer);
+  CU_ASSERT(event_loop(&expired));
+
+  (void) clock_gettime(CLOCK_MONOTONIC, &after);
+
+  CU_ASSERT((after.tv_sec - before.tv_sec) * 1000000000L
+      + (after.tv_nsec - before.tv_nsec) >= 20000000L);
+
+  /* A reset timer fires again. */
+  expired = false;
+  CU_ASSERT(event_reset_timer(timer, &timeout));
+  CU_ASSERT(event_loop(&expired));
+
+  event_remove(timer);
+}
+
+void test_event_watch_signal(void)
+{
+  bool received = false;
+  struct event_source *source = event_watch_signal(SIGUSR1, set_flag,
+      &received);
+  sigset_t blocked;
+
+  CU_ASSERT_PTR_NOT_NULL(source);
+  CU_ASSERT_PTR_NULL(event_watch_signal(SIGUSR1, set_flag, &received));
+
+  CU_ASSERT(kill(getpid(), SIGUSR1) == 0);
+  CU_ASSERT(event_loop(&received));
+
+  /* A pending signal must not be delivered after it is unwatched. */
+  CU_ASSERT(kill(getpid(), SIGUSR1) == 0);
+  event_remove(source);
+
+  CU_ASSERT(sigprocmask(SIG_BLOCK, NULL, &blocked) == 0);
+  CU_ASSERT(sigismember(&blocked, SIGUSR1) == 0);
+}
+
+void test_event_watch_child(void)
+{
+  bool died = false;
+  struct event_source *source;
+  pid_t pid = fork();
+
+  if (pid == 0) {
+    usleep(10000);
+    _exit(0);
+  }
+
+  source = event_watch_child(pid, set_flag, &died);
+
+  if (source != NULL) {
+    CU_ASSERT(event_loop(&died));
+    event_remove(source);
+  }
+
+  CU_ASSERT(waitpid(pid, NULL, 0) == pid);
+}
+
+void test_event_sleep(void)
+{
+  struct timespec timeout = { 0, 10000000 };
+  struct timespec before;
+  struct timespec after;
+
+  (void) clock_gettime(CLOCK_MONOTONIC, &before);
+  CU_ASSERT(event_sleep(&timeout));
+  (void) clock_gettime(CLOCK_MONOTONIC, &after);
+
+  CU_ASSERT((after.tv_sec - before.tv_sec) * 1000000000L
+      + (after.tv_nsec - before.tv_nsec) >= 10000000L);
+}
+
+CU_TestInfo event_tests[] = {
+  { "test_event_watch_fd", test_event_watch_fd },
+  { "test_event_add_timer", test_event_add_timer },
+  { "test_event_watch_signal", test_event_watch_signal },
+  { "test_event_watch_child", test_event_watch_child },
+  { "test_event_sleep", test_event_sleep },
+  CU_TEST_INFO_NULL,
+};
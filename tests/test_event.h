@@ -0,0 +1 @@
+extern CU_TestInfo event_tests[];
@@ -108,6 +108,47 @@ void test_list_append(void)
   list_free(l);
 }
 
+void test_list_insert_after(void)
+{
+  struct list *l = list_new();
+
+  list_insert_after(l, NULL, (void *)2);
+
+  CU_ASSERT_PTR_EQUAL(l->first, l->last);
+  CU_ASSERT_PTR_EQUAL(l->first->data, (void *)2);
+
+  list_insert_after(l, NULL, (void *)1);
+
+  CU_ASSERT_PTR_EQUAL(l->first->data, (void *)1);
+  CU_ASSERT_PTR_EQUAL(l->first->next, l->last);
+  CU_ASSERT_PTR_EQUAL(l->last->previous, l->first);
+  CU_ASSERT_PTR_NULL(l->first->previous);
+
+  list_insert_after(l, l->last, (void *)4);
+
+  CU_ASSERT_PTR_EQUAL(l->last->data, (void *)4);
+  CU_ASSERT_PTR_NULL(l->last->next);
+
+  list_insert_after(l, l->first->next, (void *)3);
+
+  CU_ASSERT_EQUAL(list_length(l), 4);
+
+  {
+    size_t i = 1;
+
+    list_for_each(l, item) {
+      CU_ASSERT_PTR_EQUAL(item->data, (void *)i);
+
+      if (item->next != NULL)
+        CU_ASSERT_PTR_EQUAL(item->next->previous, item);
+
+      i++;
+    }
+  }
+
+  list_free(l);
+}
+
 void test_list_delete_item(void)
 {
   struct list *l = list_new();
@@ -181,6 +222,7 @@ CU_TestInfo list_tests[] = {
   { "test_list_free", test_list_free },
   { "test_list_length", test_list_length },
   { "test_list_append", test_list_append },
+  { "test_list_insert_after", test_list_insert_after },
   { "test_list_delete_item", test_list_delete_item },
   { "test_list_delete", test_list_delete },
   { "test_list_find", test_list_find },
@@ -1,10 +1,16 @@
 #include <sys/types.h>
 #include <sys/wait.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <time.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <signal.h>
 #include <errno.h>
 #include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <dirent.h>
 
 #include <CUnit/CUnit.h>
 
@@ -22,8 +28,8 @@ void test_wait_for_death(void)
     _exit(1);
   }
 
-  CU_ASSERT(!wait_for_death(pid, 0, 2000));
-  CU_ASSERT(wait_for_death(pid, 0, 20000));
+  CU_ASSERT(!wait_for_death(pid, &(struct timespec){ 0, 2000000 }));
+  CU_ASSERT(wait_for_death(pid, &(struct timespec){ 0, 20000000 }));
 }
 
 void test_ensure_death(void)
@@ -43,6 +49,63 @@ void test_ensure_death(void)
   CU_ASSERT(errno == ECHILD);
 }
 
+void test_wait_for_children(void)
+{
+  pid_t pids[3];
+  struct itimerval timer = { { 0, 0 }, { 60, 0 } };
+  struct itimerval otimer;
+  struct sigaction oldact;
+
+  /* Neither the timer nor the handler may be touched. */
+  CU_ASSERT(setitimer(ITIMER_REAL, &timer, NULL) == 0);
+
+  for (size_t i = 0; i < 3; i++) {
+    pids[i] = fork();
+
+    if (pids[i] == 0) {
+      usleep(20000 * i);
+      _exit(0);
+    }
+  }
+
+  CU_ASSERT(!wait_for_children(pids, 3, &(struct timespec){ 0, 5000000 }));
+  CU_ASSERT(pids[0] == 0);
+  CU_ASSERT(pids[2] != 0);
+
+  CU_ASSERT(wait_for_children(pids, 3, &(struct timespec){ 0, 200000000 }));
+  CU_ASSERT(pids[1] == 0);
+  CU_ASSERT(pids[2] == 0);
+
+  CU_ASSERT(sigaction(SIGALRM, NULL, &oldact) == 0);
+  CU_ASSERT(oldact.sa_handler == SIG_DFL);
+
+  timer.it_value.tv_sec = 0;
+  CU_ASSERT(setitimer(ITIMER_REAL, &timer, &otimer) == 0);
+  CU_ASSERT(otimer.it_value.tv_sec > 50);
+}
+
+void test_ensure_children_death(void)
+{
+  pid_t pids[2];
+
+  for (size_t i = 0; i < 2; i++) {
+    pids[i] = fork();
+
+    if (pids[i] == 0) {
+      signal(SIGTERM, SIG_IGN);
+      pause();
+      _exit(0);
+    }
+  }
+
+  ensure_children_death(pids, 2);
+
+  CU_ASSERT(pids[0] == 0);
+  CU_ASSERT(pids[1] == 0);
+  CU_ASSERT(waitpid(-1, NULL, WNOHANG) < 0);
+  CU_ASSERT(errno == ECHILD);
+}
+
 int child_function(void *a)
 {
   char *s = a;
@@ -133,13 +196,128 @@ void test_create_child_process(void)
 
   CU_ASSERT(strncmp(buffer, s2, l2) == 0);
 
-  CU_ASSERT(wait_for_death(child.pid, 0, 0));
+  CU_ASSERT(wait_for_death(child.pid, NULL));
+}
+
+void test_create_child_exec_failure(void)
+{
+  const char *argv[] = { "/nonexistent", NULL };
+  struct child_process child = {
+    .path = "/nonexistent",
+    .argv = argv,
+    .stdin_fd = REDIRECT_PIPE,
+    .stdout_fd = REDIRECT_DEV_NULL,
+    .stderr_fd = REDIRECT_DEV_NULL,
+    .function = NULL,
+  };
+
+  CU_ASSERT(!create_child(&child));
+  CU_ASSERT(errno == ENOENT);
+  CU_ASSERT(child.stdin_fd == REDIRECT_PIPE);
+}
+
+/* Check that no descriptor above stderr is open except the one that lists
+ * them. */
+static int check_fds_closed(void __attribute__((unused)) *argument)
+{
+  DIR *dir = opendir("/proc/self/fd");
+  struct dirent *entry;
+  int result = 0;
+
+  if (dir == NULL)
+    return 2;
+
+  while ((entry = readdir(dir)) != NULL) {
+    int fd = atoi(entry->d_name);
+
+    if (entry->d_name[0] != '.' && fd > STDERR_FILENO && fd != dirfd(dir))
+      result = 1;
+  }
+
+  (void) closedir(dir);
+
+  return result;
+}
+
+/* Run a function child and a script that check that the given descriptor was
+ * closed. */
+static void check_child_fds(int fd)
+{
+  char command[64];
+  const char *argv[] = { "/bin/sh", "-c", command, NULL };
+  struct child_process function_child = {
+    .function = check_fds_closed,
+    .argument = NULL,
+    .stdin_fd = REDIRECT_DEV_NULL,
+    .stdout_fd = REDIRECT_DEV_NULL,
+    .stderr_fd = NO_REDIRECT,
+  };
+  struct child_process exec_child = {
+    .path = "/bin/sh",
+    .argv = argv,
+    .function = NULL,
+    .stdin_fd = REDIRECT_DEV_NULL,
+    .stdout_fd = REDIRECT_DEV_NULL,
+    .stderr_fd = NO_REDIRECT,
+  };
+  int status;
+
+  (void) snprintf(command, sizeof command, "test ! -e /proc/self/fd/%d", fd);
+
+  CU_ASSERT(create_child(&function_child));
+  CU_ASSERT(waitpid(function_child.pid, &status, 0) == function_child.pid);
+  CU_ASSERT(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+  CU_ASSERT(create_child(&exec_child));
+  CU_ASSERT(waitpid(exec_child.pid, &status, 0) == exec_child.pid);
+  CU_ASSERT(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+}
+
+void test_create_child_many_fds(void)
+{
+  struct rlimit old_r;
+  struct rlimit r;
+  rlim_t large_limit = 1 << 20;
+  int low_fd;
+  int high_fd;
+
+  /* Nothing to check without procfs. */
+  if (access("/proc/self/fd", F_OK) < 0)
+    return;
+
+  CU_ASSERT(getrlimit(RLIMIT_NOFILE, &old_r) == 0);
+
+  if (old_r.rlim_max != RLIM_INFINITY && old_r.rlim_max < large_limit)
+    large_limit = old_r.rlim_max;
+
+  r = old_r;
+  r.rlim_cur = large_limit;
+  CU_ASSERT(setrlimit(RLIMIT_NOFILE, &r) == 0);
+
+  /* Descriptors that are not close-on-exec, right above stderr and just below
+   * the limit. */
+  low_fd = dup(STDERR_FILENO);
+  high_fd = dup2(STDERR_FILENO, large_limit - 1);
+  CU_ASSERT(low_fd > STDERR_FILENO);
+  CU_ASSERT(high_fd >= 0);
+
+  check_child_fds(low_fd);
+  check_child_fds(high_fd);
+
+  (void) close(low_fd);
+  (void) close(high_fd);
+
+  CU_ASSERT(setrlimit(RLIMIT_NOFILE, &old_r) == 0);
 }
 
 CU_TestInfo process_tests[] = {
   { "test_wait_for_death", test_wait_for_death },
   { "test_ensure_death", test_ensure_death },
+  { "test_wait_for_children", test_wait_for_children },
+  { "test_ensure_children_death", test_ensure_children_death },
   { "test_create_child_function", test_create_child_function },
   { "test_create_child_process", test_create_child_process },
+  { "test_create_child_exec_failure", test_create_child_exec_failure },
+  { "test_create_child_many_fds", test_create_child_many_fds },
   CU_TEST_INFO_NULL,
 };
@@ -0,0 +1,283 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <CUnit/CUnit.h>
+
+#include "list.h"
+#include "plugin.h"
+#include "script_cache.h"
+
+#include "test_script_cache.h"
+
+#define CACHE_FILE VLOCK_CACHE_DIR "/scripts"
+
+/* The indices of "succeeds" and "depends" in dependency_names. */
+#define SUCCEEDS 0
+#define DEPENDS 4
+
+static char script_path[] = VLOCK_CACHE_DIR "/test-script.XXXXXX";
+
+static void new_dependencies(struct list **dependencies)
+{
+  for (size_t i = 0; i < nr_dependencies; i++)
+    dependencies[i] = list_new();
+}
+
+static void free_dependencies(struct list **dependencies)
+{
+  for (size_t i = 0; i < nr_dependencies; i++) {
+    list_delete_for_each(dependencies[i], item)
+      free(item->data);
+
+    list_free(dependencies[i]);
+  }
+}
+
+static bool dependencies_are_empty(struct list **dependencies)
+{
+  for (size_t i = 0; i < nr_dependencies; i++)
+    if (!list_is_empty(dependencies[i]))
+      return false;
+
+  return true;
+}
+
+/* Create an empty cache and a script.  Returns false if the cache cannot be
+ * written by this user. */
+static bool create_script(struct stat *st)
+{
+  int fd;
+
+  if (geteuid() != 0)
+    return false;
+
+  (void) unlink(CACHE_FILE);
+
+  strcpy(script_path + strlen(script_path) - 6, "XXXXXX");
+  fd = mkstemp(script_path);
+
+  if (fd < 0)
+    return false;
+
+  if (write(fd, "#!/bin/sh\n", 10) != 10) {
+    (void) close(fd);
+    return false;
+  }
+
+  (void) close(fd);
+
+  return stat(script_path, st) == 0;
+}
+
+/* Store "a b" as what the script succeeds and "c" as what it depends on. */
+static void store_script(const struct stat *st)
+{
+  struct list *dependencies[nr_dependencies];
+
+  new_dependencies(dependencies);
+  (void) list_append(dependencies[SUCCEEDS], strdup("a"));
+  (void) list_append(dependencies[SUCCEEDS], strdup("b"));
+  (void) list_append(dependencies[DEPENDS], strdup("c"));
+
+  script_cache_store(script_path, st, dependencies);
+
+  free_dependencies(dependencies);
+}
+
+static void remove_script(void)
+{
+  (void) unlink(script_path);
+  (void) unlink(CACHE_FILE);
+}
+
+/* Look up the script and check that the stored dependencies are found exactly
+ * once. */
+static bool lookup_stored(const struct stat *st)
+{
+  struct list *dependencies[nr_dependencies];
+  bool result;
+
+  new_dependencies(dependencies);
+
+  result = script_cache_lookup(script_path, st, dependencies)
+    && list_length(dependencies[SUCCEEDS]) == 2
+    && strcmp(dependencies[SUCCEEDS]->first->data, "a") == 0
+    && strcmp(dependencies[SUCCEEDS]->last->data, "b") == 0
+    && list_length(dependencies[DEPENDS]) == 1
+    && strcmp(dependencies[DEPENDS]->first->data, "c") == 0;
+
+  free_dependencies(dependencies);
+
+  return result;
+}
+
+/* Look up the script and check that nothing is found. */
+static bool lookup_nothing(const struct stat *st)
+{
+  struct list *dependencies[nr_dependencies];
+  bool result;
+
+  new_dependencies(dependencies);
+
+  errno = 0;
+  result = !script_cache_lookup(script_path, st, dependencies)
+    && errno == 0
+    && dependencies_are_empty(dependencies);
+
+  free_dependencies(dependencies);
+
+  return result;
+}
+
+void test_script_cache_stale(void)
+{
+  struct stat st;
+  struct stat changed;
+
+  if (!create_script(&st))
+    return;
+
+  store_script(&st);
+
+  CU_ASSERT(lookup_stored(&st));
+
+  /* Changing the size invalidates the entry. */
+  changed = st;
+  changed.st_size++;
+  CU_ASSERT(lookup_nothing(&changed));
+
+  /* So does changing the modification time. */
+  changed = st;
+  changed.st_mtim.tv_sec++;
+  CU_ASSERT(lookup_nothing(&changed));
+
+  changed = st;
+  changed.st_mtim.tv_nsec = (changed.st_mtim.tv_nsec + 1) % 1000000000L;
+  CU_ASSERT(lookup_nothing(&changed));
+
+  /* And replacing the script. */
+  changed = st;
+  changed.st_ino++;
+  CU_ASSERT(lookup_nothing(&changed));
+
+  remove_script();
+}
+
+void test_script_cache_untrusted(void)
+{
+  struct stat st;
+
+  if (!create_script(&st))
+    return;
+
+  store_script(&st);
+
+  /* The cache is written with mode 0644. */
+  CU_ASSERT(lookup_stored(&st));
+
+  CU_ASSERT(chmod(CACHE_FILE, 0664) == 0);
+  CU_ASSERT(lookup_nothing(&st));
+
+  CU_ASSERT(chmod(CACHE_FILE, 0646) == 0);
+  CU_ASSERT(lookup_nothing(&st));
+
+  CU_ASSERT(chmod(CACHE_FILE, 0644) == 0);
+  CU_ASSERT(chown(CACHE_FILE, 1, -1) == 0);
+  CU_ASSERT(lookup_nothing(&st));
+
+  CU_ASSERT(chown(CACHE_FILE, 0, -1) == 0);
+  CU_ASSERT(lookup_stored(&st));
+
+  /* Links are not followed. */
+  CU_ASSERT(rename(CACHE_FILE, CACHE_FILE ".target") == 0);
+  CU_ASSERT(symlink(CACHE_FILE ".target", CACHE_FILE) == 0);
+  CU_ASSERT(lookup_nothing(&st));
+  (void) unlink(CACHE_FILE ".target");
+
+  remove_script();
+}
+
+/* Replace the cache with a single line for the script that has the given
+ * dependency fields. */
+static void write_entry(const struct stat *st, const char *fields)
+{
+  FILE *f = fopen(CACHE_FILE, "w");
+
+  if (f == NULL)
+    return;
+
+  (void) fchmod(fileno(f), 0644);
+
+  fprintf(f, "%s\t%ju\t%ju\t%jd\t%jd\t%ld\t%s",
+      script_path,
+      (uintmax_t) st->st_dev,
+      (uintmax_t) st->st_ino,
+      (intmax_t) st->st_size,
+      (intmax_t) st->st_mtim.tv_sec,
+      (long) st->st_mtim.tv_nsec,
+      fields);
+
+  (void) fclose(f);
+}
+
+static size_t count_lines(void)
+{
+  FILE *f = fopen(CACHE_FILE, "r");
+  size_t n = 0;
+  int c;
+
+  if (f == NULL)
+    return 0;
+
+  while ((c = fgetc(f)) != EOF)
+    if (c == '\n')
+      n++;
+
+  (void) fclose(f);
+
+  return n;
+}
+
+void test_script_cache_malformed(void)
+{
+  struct stat st;
+
+  if (!create_script(&st))
+    return;
+
+  /* A truncated line. */
+  write_entry(&st, "a b\t\t\t\tc\t");
+  CU_ASSERT(lookup_nothing(&st));
+
+  /* Too few fields. */
+  write_entry(&st, "a b\t\t\tc\n");
+  CU_ASSERT(lookup_nothing(&st));
+
+  /* Too many fields. */
+  write_entry(&st, "a b\t\t\t\tc\t\tx\n");
+  CU_ASSERT(lookup_nothing(&st));
+
+  /* Storing the dependencies replaces the broken entry and they are found only
+   * once. */
+  write_entry(&st, "a b\t\t\t\tc\t");
+  store_script(&st);
+  CU_ASSERT(lookup_stored(&st));
+  CU_ASSERT(count_lines() == 1);
+
+  remove_script();
+}
+
+CU_TestInfo script_cache_tests[] = {
+  { "test_script_cache_stale", test_script_cache_stale },
+  { "test_script_cache_untrusted", test_script_cache_untrusted },
+  { "test_script_cache_malformed", test_script_cache_malformed },
+  CU_TEST_INFO_NULL,
+};
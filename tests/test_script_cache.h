@@ -0,0 +1 @@
+extern CU_TestInfo script_cache_tests[];
@@ -0,0 +1,118 @@
+#if !defined(__FreeBSD__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <termios.h>
+
+#include <CUnit/CUnit.h>
+
+#include "terminal.h"
+
+#include "test_terminal.h"
+
+static int master_fd = -1;
+static int slave_fd = -1;
+
+static bool open_terminal(void)
+{
+  master_fd = posix_openpt(O_RDWR | O_NOCTTY);
+
+  if (master_fd < 0 || grantpt(master_fd) < 0 || unlockpt(master_fd) < 0)
+    return false;
+
+  slave_fd = open(ptsname(master_fd), O_RDWR | O_NOCTTY);
+
+  return slave_fd >= 0 && terminal_init(slave_fd);
+}
+
+static void close_terminal(void)
+{
+  (void) close(slave_fd);
+  (void) close(master_fd);
+}
+
+static tcflag_t get_lflag(void)
+{
+  struct termios term;
+
+  CU_ASSERT(tcgetattr(slave_fd, &term) == 0);
+
+  return term.c_lflag;
+}
+
+void test_terminal_apply(void)
+{
+  unsigned long ioctls;
+  tcflag_t lflag;
+
+  CU_ASSERT_FATAL(open_terminal());
+
+  ioctls = terminal_ioctls();
+
+  /* Nothing changed. */
+  CU_ASSERT(terminal_apply(false));
+  CU_ASSERT(terminal_ioctls() == ioctls);
+
+  lflag = terminal_set_lflag(0, ICANON);
+  CU_ASSERT(terminal_apply(false));
+  CU_ASSERT(terminal_ioctls() == ioctls + 1);
+  CU_ASSERT((get_lflag() & ICANON) == 0);
+
+  /* Changes that cancel each other out are not applied. */
+  terminal_reset_lflag(lflag);
+  (void) terminal_set_lflag(0, ICANON);
+  CU_ASSERT(terminal_apply(false));
+  CU_ASSERT(terminal_ioctls() == ioctls + 1);
+
+  /* Discarding input needs an ioctl even if nothing changed. */
+  CU_ASSERT(write(master_fd, "x", 1) == 1);
+  CU_ASSERT(terminal_apply(true));
+  CU_ASSERT(terminal_ioctls() == ioctls + 2);
+
+  terminal_reset_lflag(lflag);
+  CU_ASSERT(terminal_apply(false));
+  CU_ASSERT(terminal_ioctls() == ioctls + 3);
+  CU_ASSERT(get_lflag() == lflag);
+
+  close_terminal();
+}
+
+void test_terminal_restore(void)
+{
+  tcflag_t lflag;
+  unsigned long ioctls;
+
+  CU_ASSERT_FATAL(open_terminal());
+
+  lflag = get_lflag();
+  ioctls = terminal_ioctls();
+
+  /* Nothing to restore. */
+  terminal_restore();
+  CU_ASSERT(terminal_ioctls() == ioctls);
+
+  (void) terminal_set_lflag(0, ECHO | ICANON);
+  CU_ASSERT(terminal_apply(false));
+  CU_ASSERT(get_lflag() == (lflag & ~(ECHO | ICANON)));
+
+  /* Restoring ignores the wanted flags. */
+  (void) terminal_set_lflag(0, ISIG);
+  terminal_restore();
+  CU_ASSERT(terminal_ioctls() == ioctls + 2);
+  CU_ASSERT(get_lflag() == lflag);
+
+  CU_ASSERT(terminal_apply(false));
+  CU_ASSERT(terminal_ioctls() == ioctls + 2);
+
+  close_terminal();
+}
+
+CU_TestInfo terminal_tests[] = {
+  { "test_terminal_apply", test_terminal_apply },
+  { "test_terminal_restore", test_terminal_restore },
+  CU_TEST_INFO_NULL,
+};
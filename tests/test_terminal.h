@@ -0,0 +1 @@
+extern CU_TestInfo terminal_tests[];
@@ -0,0 +1,70 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <CUnit/CUnit.h>
+
+#include "trace.h"
+
+#include "test_trace.h"
+
+/* Read the whole file. */
+static char *read_trace(const char *path)
+{
+  FILE *f = fopen(path, "r");
+  char *data = calloc(1, 65536);
+
+  if (f != NULL && data != NULL)
+    (void) fread(data, 1, 65535, f);
+
+  if (f != NULL)
+    (void) fclose(f);
+
+  return data;
+}
+
+void test_trace_write(void)
+{
+  char path[] = "/tmp/vlock-test-trace.XXXXXX";
+  int fd = mkstemp(path);
+  char *data;
+
+  CU_ASSERT_FATAL(fd >= 0);
+  (void) close(fd);
+
+  /* Not recorded before tracing is started. */
+  trace_begin("before", NULL);
+  trace_end();
+
+  /* The trace written on exit is thrown away. */
+  (void) setenv("VLOCK_TRACE", "/dev/null", 1);
+  CU_ASSERT(trace_init());
+  (void) unsetenv("VLOCK_TRACE");
+
+  trace_begin("outer", "a \"quoted\"\ndetail");
+  trace_begin("inner", NULL);
+  trace_end();
+  trace_end();
+
+  CU_ASSERT(trace_write(path));
+
+  data = read_trace(path);
+
+  CU_ASSERT_PTR_NOT_NULL_FATAL(data);
+  CU_ASSERT(strncmp(data, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[", 39) == 0);
+  CU_ASSERT(strstr(data, "\"before\"") == NULL);
+  CU_ASSERT(strstr(data, "\"ph\":\"B\"") != NULL);
+  CU_ASSERT(strstr(data, "\"ph\":\"E\"") != NULL);
+  CU_ASSERT(strstr(data, "\"name\":\"outer\",\"args\":{\"detail\":\"a \\\"quoted\\\"\\u000adetail\"}") != NULL);
+  CU_ASSERT(strstr(data, "\"name\":\"inner\"}") != NULL);
+  CU_ASSERT(strstr(data, "\"dropped_events\":0}}") != NULL);
+
+  free(data);
+  (void) unlink(path);
+}
+
+CU_TestInfo trace_tests[] = {
+  { "test_trace_write", test_trace_write },
+  CU_TEST_INFO_NULL,
+};
@@ -0,0 +1 @@
+extern CU_TestInfo trace_tests[];
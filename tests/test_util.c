@@ -9,32 +9,47 @@
 
 void test_parse_timespec(void)
 {
-  struct timespec *t = parse_seconds("123");
-
-  CU_ASSERT_PTR_NOT_NULL(t);
-  CU_ASSERT(t->tv_sec == 123);
-  CU_ASSERT(t->tv_nsec == 0);
+  struct timespec t;
+
+  CU_ASSERT(parse_seconds("123", &t));
+  CU_ASSERT(t.tv_sec == 123);
+  CU_ASSERT(t.tv_nsec == 0);
+
+  CU_ASSERT(parse_seconds("123.4", &t));
+  CU_ASSERT(t.tv_sec == 123);
+  CU_ASSERT(t.tv_nsec == 400000000);
+
+  CU_ASSERT(parse_seconds("0.005", &t));
+  CU_ASSERT(t.tv_sec == 0);
+  CU_ASSERT(t.tv_nsec == 5000000);
+
+  CU_ASSERT(!parse_seconds(NULL, &t));
+  CU_ASSERT(!parse_seconds("0", &t));
+  CU_ASSERT(!parse_seconds("0.0", &t));
+  CU_ASSERT(!parse_seconds("-1", &t));
+  CU_ASSERT(!parse_seconds("1.5s", &t));
+  CU_ASSERT(!parse_seconds("hello", &t));
+}
 
-  free(t);
+void test_deadline(void)
+{
+  struct timespec timeout = { 0, 20000000 };
+  struct timespec deadline;
+  struct timespec remaining;
 
-#if 0
-  /* Fractions are not supported, yet. */
-  t = parse_seconds("123.4");
+  get_deadline(&timeout, &deadline);
 
-  CU_ASSERT_PTR_NOT_NULL(t);
-  CU_ASSERT(t->tv_sec == 123);
-  CU_ASSERT(t->tv_nsec == 400000);
+  CU_ASSERT(get_remaining(&deadline, &remaining));
+  CU_ASSERT(remaining.tv_sec == 0);
+  CU_ASSERT(remaining.tv_nsec > 0 && remaining.tv_nsec <= 20000000);
 
-  free(t);
-#else
-  CU_ASSERT_PTR_NULL(parse_seconds("123.4"));
-#endif
+  (void) nanosleep(&timeout, NULL);
 
-  CU_ASSERT_PTR_NULL(parse_seconds("-1"));
-  CU_ASSERT_PTR_NULL(parse_seconds("hello"));
+  CU_ASSERT(!get_remaining(&deadline, &remaining));
 }
 
 CU_TestInfo util_tests[] = {
   { "test_parse_timespec", test_parse_timespec },
+  { "test_deadline", test_deadline },
   CU_TEST_INFO_NULL,
 };
@@ -0,0 +1,356 @@
+/* vlock-bench.c -- latency benchmark driver for vlock,
+ *                  the VT locking program for linux
+ *
+ * This program is copyright (C) 2007 Frank Benkstein, and is free
+ * software which is freely distributable under the terms of the
+ * GNU General Public License version 2, included as the file COPYING in this
+ * distribution.  It is NOT public domain software, and any
+ * redistribution not permitted by the GNU General Public License is
+ * expressly forbidden without prior written permission from
+ * the author.
+ *
+ */
+
+/* The given command is run repeatedly on the slave side of a pseudo terminal.
+ * For each run the following phases are measured:
+ *
+ * time-to-locked:  from starting the command until the lock message appears,
+ * keypress-to-prompt:  from pressing enter until the password prompt appears,
+ * password-to-exit:  from entering the password until the command exits.
+ *
+ * With -f the given number of wrong passwords is entered before the right one.
+ * The time from pressing enter again until the password prompt appears is
+ * reported separately as retry-to-prompt.  This shows what the first attempt
+ * costs compared to the following ones, e.g. for starting PAM.
+ *
+ * The password is also put into VLOCK_BENCH_PASSWORD for the stand-in
+ * authentification backend of vlock-main-bench.  With -l only the first phase
+ * is measured and the command is terminated with SIGTERM afterwards.  This
+ * works with any vlock-main. */
+
+#if !defined(__FreeBSD__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/ioctl.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+/* How long to wait for any output before giving up. */
+#define OUTPUT_TIMEOUT_MS 5000
+
+/* The default lock messages end with this. */
+#define DEFAULT_MARKER "[ENTER] to unlock."
+/* The password prompt ends with this. */
+#define DEFAULT_PROMPT_MARKER "Password: "
+/* The password the stand-in authentification backend accepts. */
+#define DEFAULT_PASSWORD "bench"
+
+static double now_ms(void)
+{
+  struct timespec t;
+  (void) clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec * 1000.0 + t.tv_nsec / 1000000.0;
+}
+
+/* Start the command on a new pseudo terminal.  The master side is returned
+ * through master_fd. */
+static pid_t spawn_on_pty(char *const argv[], int *master_fd)
+{
+  int master = posix_openpt(O_RDWR | O_NOCTTY);
+  char *slave_name;
+  pid_t pid;
+
+  if (master < 0 || grantpt(master) < 0 || unlockpt(master) < 0)
+    return -1;
+
+  slave_name = ptsname(master);
+
+  if (slave_name == NULL)
+    return -1;
+
+  pid = fork();
+
+  if (pid == 0) {
+    int slave;
+
+    (void) setsid();
+
+    slave = open(slave_name, O_RDWR);
+
+    if (slave < 0)
+      _exit(127);
+
+#ifdef TIOCSCTTY
+    (void) ioctl(slave, TIOCSCTTY, 0);
+#endif
+
+    (void) dup2(slave, STDIN_FILENO);
+    (void) dup2(slave, STDOUT_FILENO);
+    (void) dup2(slave, STDERR_FILENO);
+
+    if (slave > STDERR_FILENO)
+      (void) close(slave);
+
+    (void) close(master);
+
+    execvp(argv[0], argv);
+    _exit(127);
+  }
+
+  if (pid < 0) {
+    (void) close(master);
+    return -1;
+  }
+
+  *master_fd = master;
+  return pid;
+}
+
+/* Read from the terminal until the marker string was seen.  Returns false on
+ * timeout, error or end-of-file. */
+static bool wait_for_output(int fd, const char *marker)
+{
+  char buffer[4096];
+  size_t length = 0;
+  size_t marker_length = strlen(marker);
+
+  for (;;) {
+    struct pollfd pfd = { .fd = fd, .events = POLLIN };
+    ssize_t n;
+
+    if (poll(&pfd, 1, OUTPUT_TIMEOUT_MS) != 1)
+      return false;
+
+    n = read(fd, buffer + length, sizeof buffer - 1 - length);
+
+    if (n <= 0)
+      return false;
+
+    length += n;
+    buffer[length] = '\0';
+
+    if (strstr(buffer, marker) != NULL)
+      return true;
+
+    /* Keep the tail in case the marker was split between reads. */
+    if (length > marker_length) {
+      memmove(buffer, buffer + length - marker_length, marker_length);
+      length = marker_length;
+    }
+  }
+}
+
+/* Read from the terminal until the other side is closed, i.e. the command
+ * exited.  Returns false on timeout. */
+static bool wait_for_hangup(int fd)
+{
+  char buffer[4096];
+
+  for (;;) {
+    struct pollfd pfd = { .fd = fd, .events = POLLIN };
+
+    if (poll(&pfd, 1, OUTPUT_TIMEOUT_MS) != 1)
+      return false;
+
+    if (read(fd, buffer, sizeof buffer) <= 0)
+      return true;
+  }
+}
+
+static bool write_string(int fd, const char *s)
+{
+  size_t length = strlen(s);
+
+  return write(fd, s, length) == (ssize_t) length;
+}
+
+static int compare_doubles(const void *a, const void *b)
+{
+  double x = *(const double *)a;
+  double y = *(const double *)b;
+
+  return (x > y) - (x < y);
+}
+
+static double percentile(const double *sorted, size_t n, int p)
+{
+  size_t i = (n * p + 99) / 100;
+
+  return sorted[i > 0 ? i - 1 : 0];
+}
+
+static void report(const char *name, double *samples, size_t n)
+{
+  qsort(samples, n, sizeof *samples, compare_doubles);
+
+  printf("%-24s n=%-5zu p50=%8.3fms p95=%8.3fms p99=%8.3fms\n", name, n,
+      percentile(samples, n, 50),
+      percentile(samples, n, 95),
+      percentile(samples, n, 99));
+}
+
+static void usage(const char *name)
+{
+  fprintf(stderr, "Usage: %s [-l] [-n iterations] [-f failures] [-m marker] [-P prompt] [-p password]\n"
+      "       command [arguments...]\n", name);
+  exit(EXIT_FAILURE);
+}
+
+static void fail(const char *command, const char *what, pid_t pid)
+{
+  fprintf(stderr, "vlock-bench: '%s' %s\n", command, what);
+  (void) kill(pid, SIGKILL);
+  (void) waitpid(pid, NULL, 0);
+  exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *const argv[])
+{
+  const char *marker = DEFAULT_MARKER;
+  const char *prompt_marker = DEFAULT_PROMPT_MARKER;
+  const char *password = DEFAULT_PASSWORD;
+  bool lock_only = false;
+  size_t iterations = 100;
+  size_t failures = 0;
+  double *locked;
+  double *prompted;
+  double *retried;
+  double *unlocked;
+  char *password_line;
+  char *wrong_password_line;
+  const char *command;
+  int c;
+
+  while ((c = getopt(argc, argv, "+ln:f:m:P:p:")) != -1) {
+    switch (c) {
+      case 'l':
+        lock_only = true;
+        break;
+      case 'n':
+        iterations = strtoul(optarg, NULL, 10);
+        break;
+      case 'f':
+        failures = strtoul(optarg, NULL, 10);
+        break;
+      case 'm':
+        marker = optarg;
+        break;
+      case 'P':
+        prompt_marker = optarg;
+        break;
+      case 'p':
+        password = optarg;
+        break;
+      default:
+        usage(argv[0]);
+    }
+  }
+
+  if (optind >= argc || iterations == 0)
+    usage(argv[0]);
+
+  command = argv[optind];
+
+  locked = calloc(iterations, sizeof *locked);
+  prompted = calloc(iterations, sizeof *prompted);
+  retried = calloc(iterations * failures + 1, sizeof *retried);
+  unlocked = calloc(iterations, sizeof *unlocked);
+
+  if (locked == NULL || prompted == NULL || retried == NULL || unlocked == NULL
+      || asprintf(&password_line, "%s\n", password) < 0
+      || asprintf(&wrong_password_line, "%s-wrong\n", password) < 0) {
+    perror("vlock-bench: out of memory");
+    exit(EXIT_FAILURE);
+  }
+
+  if (setenv("VLOCK_BENCH_PASSWORD", password, 1) < 0) {
+    perror("vlock-bench: setenv");
+    exit(EXIT_FAILURE);
+  }
+
+  for (size_t i = 0; i < iterations; i++) {
+    int master;
+    double start = now_ms();
+    pid_t pid = spawn_on_pty(argv + optind, &master);
+
+    if (pid < 0) {
+      perror("vlock-bench: could not start command");
+      exit(EXIT_FAILURE);
+    }
+
+    if (!wait_for_output(master, marker))
+      fail(command, "did not lock the terminal", pid);
+
+    locked[i] = now_ms() - start;
+
+    if (lock_only) {
+      (void) kill(pid, SIGTERM);
+      (void) waitpid(pid, NULL, 0);
+      (void) close(master);
+      continue;
+    }
+
+    start = now_ms();
+
+    if (!write_string(master, "\n") || !wait_for_output(master, prompt_marker))
+      fail(command, "did not prompt for the password", pid);
+
+    prompted[i] = now_ms() - start;
+
+    for (size_t j = 0; j < failures; j++) {
+      /* The lock message appears again after the failed attempt. */
+      if (!write_string(master, wrong_password_line)
+          || !wait_for_output(master, marker))
+        fail(command, "did not lock the terminal again", pid);
+
+      start = now_ms();
+
+      if (!write_string(master, "\n") || !wait_for_output(master, prompt_marker))
+        fail(command, "did not prompt for the password again", pid);
+
+      retried[i * failures + j] = now_ms() - start;
+    }
+
+    start = now_ms();
+
+    if (!write_string(master, password_line) || !wait_for_hangup(master))
+      fail(command, "did not exit after the password was entered", pid);
+
+    unlocked[i] = now_ms() - start;
+
+    (void) waitpid(pid, NULL, 0);
+    (void) close(master);
+  }
+
+  printf("%s:\n", command);
+  report("time-to-locked", locked, iterations);
+
+  if (!lock_only) {
+    report("keypress-to-prompt", prompted, iterations);
+
+    if (failures > 0)
+      report("retry-to-prompt", retried, iterations * failures);
+
+    report("password-to-exit", unlocked, iterations);
+  }
+
+  free(wrong_password_line);
+  free(password_line);
+  free(unlocked);
+  free(retried);
+  free(prompted);
+  free(locked);
+
+  return EXIT_SUCCESS;
+}
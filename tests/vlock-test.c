@@ -8,12 +8,24 @@
 #include "test_tsort.h"
 #include "test_util.h"
 #include "test_process.h"
+#include "test_event.h"
+#include "test_terminal.h"
+#include "test_auth-worker.h"
+#include "test_backoff.h"
+#include "test_trace.h"
+#include "test_script_cache.h"
 
 CU_SuiteInfo vlock_test_suites[] = {
   { "test_list" , NULL, NULL, list_tests },
   { "test_tsort", NULL, NULL, tsort_tests },
   { "test_util", NULL, NULL, util_tests },
   { "test_process", NULL, NULL, process_tests },
+  { "test_event", NULL, NULL, event_tests },
+  { "test_terminal", NULL, NULL, terminal_tests },
+  { "test_auth_worker", NULL, NULL, auth_worker_tests },
+  { "test_backoff", NULL, NULL, backoff_tests },
+  { "test_trace", NULL, NULL, trace_tests },
+  { "test_script_cache", NULL, NULL, script_cache_tests },
   CU_SUITE_INFO_NULL,
 };
 